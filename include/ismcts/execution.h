@@ -7,6 +7,8 @@
 #define ISMCTS_EXECUTION_H
 
 #include "config.h"
+#include "scheduler.h"
+#include "threadpool.h"
 #include "tree/node.h"
 #include "utility.h"
 
@@ -14,8 +16,11 @@
 #include <atomic>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <exception>
 #include <future>
 #include <memory>
+#include <random>
 #include <utility>
 #include <vector>
 #include <map>
@@ -26,6 +31,7 @@ namespace ISMCTS
 class ExecutionPolicy
 {
 public:
+    using Clock = std::chrono::steady_clock;
     using Duration = std::chrono::duration<double>;
 
     template<class Move>
@@ -43,12 +49,6 @@ public:
     {
         m_iterCount = count;
         m_iterTime = Duration::zero();
-        if (m_numThreads == 1)
-            m_chunkSize = count;
-        else
-            // Increase chunk size with number of threads and iterations to
-            // reduce contention on m_counter
-            m_chunkSize = std::max(std::size_t(1), count * m_numThreads / 1000);
     }
 
     Duration iterationTime() const
@@ -67,12 +67,81 @@ public:
         return m_numThreads;
     }
 
+    unsigned int numTrees() const
+    {
+        return m_numTrees;
+    }
+
+    // The pool executing the search threads, which is created on first use if
+    // none was set
+    std::shared_ptr<ThreadPool> threadPool()
+    {
+        if (!m_pool)
+            m_pool = std::make_shared<ThreadPool>(m_poolSize);
+        return m_pool;
+    }
+
+    void setThreadPool(std::shared_ptr<ThreadPool> pool)
+    {
+        m_pool = std::move(pool);
+    }
+
+    bool isSeeded() const
+    {
+        return m_isSeeded;
+    }
+
+    std::uint64_t seed() const
+    {
+        return m_seed;
+    }
+
+    // Make subsequent searches reproducible: each worker thread reseeds its
+    // prng() with a stream derived from this seed, the number of searches
+    // since it was set and the worker's index
+    void setSeed(std::uint64_t seed)
+    {
+        m_seed = seed;
+        m_isSeeded = true;
+        m_searchCount = 0;
+    }
+
+    // Return to randomly seeded generators. Threads whose generator was last
+    // seeded by a seeded search reseed it randomly when they next run part of
+    // an unseeded one.
+    void clearSeed()
+    {
+        m_isSeeded = false;
+    }
+
+    // Whether the threads of a search started asynchronously are still running
+    bool isSearching() const
+    {
+        return std::any_of(m_workers.begin(), m_workers.end(), [](auto const &f){
+            return f.wait_for(Duration::zero()) != std::future_status::ready;
+        });
+    }
+
+    // Ask the threads of the current search to stop after their current
+    // iteration
+    void stop()
+    {
+        m_stop = true;
+    }
+
 protected:
     unsigned int static hwThreadCount() { return std::thread::hardware_concurrency(); }
 
+    // Set the number of workers of the pool created by threadPool()
+    void setPoolSize(unsigned int size)
+    {
+        m_poolSize = size;
+    }
+
     ExecutionPolicy(unsigned int numThreads, unsigned int numTrees)
         : m_numThreads{validateCount(numThreads)}
         , m_numTrees{validateCount(numTrees)}
+        , m_poolSize{m_numThreads}
     {}
 
     ExecutionPolicy(std::size_t iterationCount, unsigned int numThreads, unsigned int numTrees)
@@ -95,34 +164,166 @@ protected:
         return trees;
     }
 
-    // Works for both Sequential and TreeParallel
-    template<class SearchOp, class TreeGenerator, class Game>
-    auto execute(SearchOp &&search, TreeGenerator &&g, Game const &rootState)
+    // Start the threads of a search, which runs until join() is called. Works
+    // for both Sequential and TreeParallel.
+    template<class SearchOp, class TreeList, class Game>
+    void execute(SearchOp &&search, TreeList &trees, Game const &rootState)
     {
-        auto trees = makeTrees(g);
-        std::vector<std::future<void>> futures(m_numThreads);
-        std::generate(futures.begin(), futures.end(), [&]{
-            return launch([&]{ search(trees[0], rootState); });
-        });
-        for (auto &f : futures)
-            f.get();
-        return trees;
+        nextSearch();
+        for (unsigned int i = 0; i < m_numThreads; ++i)
+            addWorker(launch([&trees, &rootState, search]() mutable { search(trees[0], rootState); }));
+    }
+
+    // Wait for the threads of the current search to finish. If any of them
+    // failed, the first exception is rethrown once all have finished.
+    void join()
+    {
+        std::exception_ptr error;
+        for (auto &f : m_workers) {
+            try {
+                f.get();
+            } catch (...) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        m_workers.clear();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // Stop and join the current search, discarding any exception thrown by
+    // its threads
+    void cancel() noexcept
+    {
+        stop();
+        try {
+            join();
+        } catch (...) {}
+    }
+
+    // Cancels the current search when destroyed unless dismissed, so that no
+    // thread outlives the objects of a search left by an exception. The pool's
+    // futures do not wait for their tasks when destroyed.
+    class JoinGuard
+    {
+    public:
+        explicit JoinGuard(ExecutionPolicy &policy)
+            : m_policy{&policy}
+        {}
+
+        JoinGuard(JoinGuard const &) = delete;
+        JoinGuard &operator=(JoinGuard const &) = delete;
+
+        ~JoinGuard()
+        {
+            if (m_policy)
+                m_policy->cancel();
+        }
+
+        void dismiss()
+        {
+            m_policy = nullptr;
+        }
+
+    private:
+        ExecutionPolicy *m_policy;
+    };
+
+    void addWorker(std::future<void> worker)
+    {
+        m_workers.emplace_back(std::move(worker));
     }
 
     template<class Callable>
     std::future<void> launch(Callable &&f)
     {
-        if (m_iterCount > 0) {
-            setCounter();
-            return std::async(std::launch::async, [=]{
-                executeFor(m_counter, m_chunkSize, f);
-                m_isCounterSet = false;
-            });
-        } else {
-            return std::async(std::launch::async, [=]{ executeFor(m_iterTime, f); });
+        return threadPool()->submit(prepare(std::forward<Callable>(f)));
+    }
+
+    // Make a task performing iterations of the current search by calling f.
+    // Each thread works on its own copy of the callable, so that it can hold
+    // per-thread state. The copy is destroyed before the task returns, so its
+    // destructor can still access the trees. A failing task stops the others.
+    // The limit is read here, so changing it only affects the next search.
+    template<class Callable>
+    auto prepare(Callable &&f)
+    {
+        auto const index = m_workerCount++;
+        auto const seeded = m_isSeeded;
+        auto const seed = seeded ? streamSeed(index) : 0;
+        auto const counted = m_iterCount > 0;
+        auto const deadline = m_deadline;
+        return [=]() mutable {
+            if (seeded)
+                seedThread(seed);
+            else
+                unseedThread();
+            try {
+                auto worker = std::move(f);
+                if (counted)
+                    executeFor(m_scheduler, index, m_stop, worker);
+                else
+                    executeUntil(deadline, m_stop, worker);
+            } catch (...) {
+                stop();
+                throw;
+            }
+        };
+    }
+
+    // The seed of the given random number stream of the current search
+    std::uint64_t streamSeed(std::uint64_t stream) const
+    {
+        return ISMCTS::streamSeed(m_seed, m_searchCount, stream);
+    }
+
+    // Reseed the calling thread's prng() for a seeded search
+    void static seedThread(std::uint64_t seed)
+    {
+        prng().seed(seed);
+        hasFixedSeed() = true;
+    }
+
+    // Reseed the calling thread's prng() randomly if a seeded search left it in
+    // a reproducible state
+    void static unseedThread()
+    {
+        if (hasFixedSeed()) {
+            prng().seed(std::random_device{}());
+            hasFixedSeed() = false;
         }
     }
 
+    // Call f(i) for each playout i of an iteration. Only LeafParallel runs
+    // more than one, concurrently.
+    unsigned int numPlayouts() const
+    {
+        return 1;
+    }
+
+    template<class Playout>
+    void forEachPlayout(Playout &&f) const
+    {
+        f(0u);
+    }
+
+    // Divide the iterations among the threads or set the common deadline, and
+    // start numbering the workers of a new search. This is only done here, as
+    // some workers may finish before others have been launched. The pool is
+    // created first, so that starting its threads does not use up the time.
+    void nextSearch()
+    {
+        threadPool();
+        m_stop = false;
+        if (m_iterCount > 0)
+            m_scheduler.reset(m_iterCount, m_numThreads);
+        else
+            m_deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(m_iterTime);
+        ++m_searchCount;
+        m_workerCount = 0;
+    }
+
     template<class Move>
     Move static const &bestMove(TreeList<Move> const &trees)
     {
@@ -139,18 +340,23 @@ private:
     Duration m_iterTime;
     unsigned int const m_numThreads;
     unsigned int const m_numTrees;
-    unsigned int m_chunkSize {1};
-    std::atomic_size_t m_counter;
-    std::atomic_bool m_isCounterSet {false};
+    unsigned int m_poolSize;
+    IterationScheduler m_scheduler;
+    Clock::time_point m_deadline;
+    std::atomic_bool m_stop {false};
+    std::vector<std::future<void>> m_workers;
+    std::shared_ptr<ThreadPool> m_pool;
+    std::uint64_t m_seed {0};
+    bool m_isSeeded {false};
+    std::uint64_t m_searchCount {0};
+    unsigned int m_workerCount {0};
 
     unsigned int static validateCount(unsigned int count) { return std::max(count, 1u); }
 
-    void setCounter()
+    bool static &hasFixedSeed()
     {
-        if (m_isCounterSet)
-            return;
-        m_isCounterSet = true;
-        m_counter = m_iterCount;
+        bool thread_local static fixed {false};
+        return fixed;
     }
 };
 
@@ -178,6 +384,100 @@ public:
     {}
 };
 
+class LeafParallel : public ExecutionPolicy
+{
+public:
+    explicit LeafParallel(std::size_t iterationCount = 1000, unsigned int numThreads = hwThreadCount())
+        : ExecutionPolicy{iterationCount, numThreads, 1}
+    {
+        setPoolSize(this->numThreads() - 1);
+    }
+
+    explicit LeafParallel(Duration iterationTime, unsigned int numThreads = hwThreadCount())
+        : ExecutionPolicy{iterationTime, numThreads, 1}
+    {
+        setPoolSize(this->numThreads() - 1);
+    }
+
+protected:
+    // The tree is searched by a long-lived thread of its own outside the pool,
+    // so that the pool's workers only run playouts and never wait for each
+    // other. As that thread also runs the first playout of each iteration, the
+    // pool only needs numThreads() - 1 workers. With a single thread, there are
+    // no other playouts, so the search runs on the pool like a Sequential one.
+    template<class SearchOp, class TreeList, class Game>
+    void execute(SearchOp &&search, TreeList &trees, Game const &rootState)
+    {
+        if (numThreads() == 1)
+            return ExecutionPolicy::execute(search, trees, rootState);
+        nextSearch();
+        m_pool = threadPool();
+        if (!m_searchThread)
+            m_searchThread.reset(new ThreadPool{1});
+        m_iteration = 0;
+        auto task = prepare([&trees, &rootState, search]() mutable { search(trees[0], rootState); });
+        addWorker(m_searchThread->submit(std::move(task)));
+    }
+
+    unsigned int numPlayouts() const
+    {
+        return numThreads();
+    }
+
+    // The first playout runs on the tree thread, which was seeded by prepare().
+    // The others may run on any pool thread, so if the search is seeded, each
+    // of them seeds its thread from the iteration and its own index. As these
+    // use f and the playout states, all of them are waited for before the
+    // first exception thrown by any playout is rethrown.
+    template<class Playout>
+    void forEachPlayout(Playout &&f) const
+    {
+        if (numPlayouts() == 1)
+            return f(0u);
+        auto &futures = threadBuffer<std::future<void>>();
+        futures.clear();
+        std::exception_ptr error;
+        try {
+            auto const first = ++m_iteration * numPlayouts();
+            for (unsigned int i = 1; i < numPlayouts(); ++i) {
+                if (isSeeded()) {
+                    auto const seed = streamSeed(first + i);
+                    futures.emplace_back(m_pool->submit([&f, i, seed]{
+                        seedThread(seed);
+                        f(i);
+                    }));
+                } else {
+                    futures.emplace_back(m_pool->submit([&f, i]{
+                        unseedThread();
+                        f(i);
+                    }));
+                }
+            }
+            f(0u);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        for (auto &future : futures) {
+            try {
+                future.get();
+            } catch (...) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        futures.clear();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    std::shared_ptr<ThreadPool> m_pool;
+    std::unique_ptr<ThreadPool> m_searchThread;
+
+    // Only used by the tree thread
+    std::uint64_t mutable m_iteration {0};
+};
+
 class RootParallel : public ExecutionPolicy
 {
 public:
@@ -190,17 +490,23 @@ public:
     {}
 
 protected:
-    template<class SearchOp, class TreeGenerator, class Game>
-    auto execute(SearchOp &&search, TreeGenerator &&g, Game const &rootState)
+    RootParallel(std::size_t iterationCount, unsigned int numThreads, unsigned int numTrees)
+        : ExecutionPolicy{iterationCount, numThreads, numTrees}
+    {}
+
+    RootParallel(Duration iterationTime, unsigned int numThreads, unsigned int numTrees)
+        : ExecutionPolicy{iterationTime, numThreads, numTrees}
+    {}
+
+    // Thread i searches tree i modulo the number of trees
+    template<class SearchOp, class TreeList, class Game>
+    void execute(SearchOp &&search, TreeList &trees, Game const &rootState)
     {
-        auto trees = makeTrees(g);
-        std::vector<std::future<void>> futures(numThreads());
-        std::transform(trees.begin(), trees.end(), futures.begin(), [&](auto &tree){
-            return launch([&]{ search(tree, rootState); });
-        });
-        for (auto &f : futures)
-            f.get();
-        return trees;
+        nextSearch();
+        for (std::size_t i = 0; i < numThreads(); ++i) {
+            auto &tree = trees[i % trees.size()];
+            addWorker(launch([&tree, &rootState, search]() mutable { search(tree, rootState); }));
+        }
     }
 
     // Return best move from a number of trees holding results for the same
@@ -231,6 +537,35 @@ private:
     }
 };
 
+// Searches several trees like RootParallel, each of which is shared by a
+// number of threads like TreeParallel
+class HybridParallel : public RootParallel
+{
+public:
+    explicit HybridParallel(std::size_t iterationCount = 1000, unsigned int numTrees = defaultTreeCount(),
+                            unsigned int threadsPerTree = 2)
+        : RootParallel{iterationCount, threadCount(numTrees, threadsPerTree), numTrees}
+    {}
+
+    explicit HybridParallel(Duration iterationTime, unsigned int numTrees = defaultTreeCount(),
+                            unsigned int threadsPerTree = 2)
+        : RootParallel{iterationTime, threadCount(numTrees, threadsPerTree), numTrees}
+    {}
+
+    unsigned int threadsPerTree() const
+    {
+        return numThreads() / numTrees();
+    }
+
+private:
+    unsigned int static defaultTreeCount() { return std::max(hwThreadCount() / 2, 1u); }
+
+    unsigned int static threadCount(unsigned int numTrees, unsigned int threadsPerTree)
+    {
+        return std::max(numTrees, 1u) * std::max(threadsPerTree, 1u);
+    }
+};
+
 } // ISMCTS
 
 #endif // ISMCTS_EXECUTION_H
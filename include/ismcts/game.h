@@ -23,10 +23,26 @@ struct Game
 
     virtual Clone cloneAndRandomise(Player observer) const = 0;
 
+    // Overwrite the target, a state previously obtained from cloneAndRandomise,
+    // by a determinisation of this state for the observer. This allows a solver
+    // to reuse the same state in every iteration. Returns false if this is not
+    // supported; the default does nothing.
+    virtual bool randomiseInto(Game &, Player) const
+    {
+        return false;
+    }
+
     virtual Player currentPlayer() const = 0;
 
     virtual std::vector<Move> validMoves() const = 0;
 
+    // Replace the contents of the given buffer by the valid moves. Override
+    // this to reuse the buffer's memory; the default calls validMoves().
+    virtual void fillValidMoves(std::vector<Move> &moves) const
+    {
+        moves = validMoves();
+    }
+
     virtual void doMove(Move const move) = 0;
 
     virtual double getResult(Player player) const = 0;
@@ -12,7 +12,10 @@
 #include "solverbase.h"
 #include "utility.h"
 
+#include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 #include <map>
 
@@ -33,19 +36,115 @@ public:
     // The set of tree maps, one for each thread
     using TreeList = std::vector<TreeMap>;
 
-    Move operator()(POMGame<Move> const &rootState)
+    ~MOSolver()
     {
-        auto treeSearch = [this](TreeMap &map, Game<Move> const &state){ search(map, state); };
-        auto treeGenerator = [&rootState]{ return newTree(rootState); };
-        m_trees = MOSolver::execute(treeSearch, treeGenerator, rootState);
+        MOSolver::cancel();
+    }
+
+    // If the root state is an instance of a final class, the search is compiled
+    // for that class, so that calls to its functions need no virtual dispatch
+    template<class G>
+    Move operator()(G const &rootState)
+    {
+        start(rootState);
+        return wait();
+    }
+
+    // Start searching from the given state without waiting for the result. The
+    // state must remain valid until the search has finished.
+    template<class G>
+    void start(G const &rootState)
+    {
+        static_assert(std::is_base_of<POMGame<Move>, G>::value, "G must implement POMGame<Move>");
+        using State = typename MOSolver::template SearchState<G>;
+        MOSolver::stop();
+        MOSolver::join();
+        m_player = rootState.currentPlayer();
+        if (m_reuseTrees) {
+            for (auto &map : m_trees) {
+                for (auto player : rootState.players()) {
+                    auto &tree = map[player];
+                    if (!tree)
+                        tree = this->newRoot(rootState);
+                }
+            }
+            m_reuseTrees = false;
+        } else {
+            this->newArena();
+            m_trees = MOSolver::makeTrees([&]{ return newTree(rootState); });
+        }
+        auto treeSearch = [this, workspace = Workspace{}](TreeMap &map, State const &state) mutable {
+            search(map, state, workspace);
+        };
+        typename MOSolver::JoinGuard guard {*this};
+        MOSolver::execute(treeSearch, m_trees, rootState);
+        guard.dismiss();
+    }
 
-        std::vector<RootNode> currentPlayerTrees(m_trees.size());
-        std::transform(m_trees.begin(), m_trees.end(), currentPlayerTrees.begin(), [&](auto &map){
-            return map[rootState.currentPlayer()];
+    // Wait until the current search has finished and return its result. Throws
+    // std::runtime_error if it was stopped before finding any move.
+    Move wait()
+    {
+        MOSolver::join();
+        return currentBestMove();
+    }
+
+    // Whether the trees of the current search hold a move to return
+    bool hasBestMove() const
+    {
+        return std::any_of(m_trees.begin(), m_trees.end(), [this](auto const &map){
+            auto const tree = map.find(m_player);
+            return tree != map.end() && tree->second && !tree->second->children().empty();
         });
+    }
+
+    // The best move for the searching player according to the statistics
+    // gathered so far, which may be queried while the search is running if
+    // hasBestMove() returns true
+    Move currentBestMove() const
+    {
+        if (!hasBestMove())
+            throw std::runtime_error{"The search has not found a move"};
+        // Trees discarded by advanceTrees are empty pointers
+        std::vector<RootNode> currentPlayerTrees;
+        for (auto const &map : m_trees) {
+            auto const tree = map.find(m_player);
+            if (tree != map.end() && tree->second)
+                currentPlayerTrees.emplace_back(tree->second);
+        }
         return MOSolver::template bestMove<Move>(currentPlayerTrees);
     }
 
+    // Keep the current trees for the next search, which should start from the
+    // state reached by playing the given moves. Requires a finished search;
+    // returns false if there was none, or if any of the trees did not contain
+    // these moves, in which case such trees are discarded. The next search
+    // starts afresh instead if the kept trees are small compared to the memory
+    // held by their arena.
+    bool advanceTrees(std::vector<Move> const &moves)
+    {
+        if (m_trees.empty())
+            return false;
+        bool complete {true};
+        m_reuseTrees = false;
+        for (auto &map : m_trees) {
+            for (auto &pair : map) {
+                this->advance(pair.second, moves);
+                complete = complete && pair.second;
+                m_reuseTrees = m_reuseTrees || pair.second;
+            }
+        }
+        m_reuseTrees = m_reuseTrees && this->canReuseArena([this]{
+            std::size_t bytes {0};
+            for (auto const &map : m_trees) {
+                for (auto const &pair : map)
+                    bytes += pair.second ? pair.second->treeMemoryUsage() : 0;
+            }
+            return bytes;
+        });
+        return complete;
+    }
+
     TreeList currentTrees() const
     {
         return m_trees;
@@ -53,61 +152,88 @@ public:
 
 protected:
     using NodePtrMap = std::map<unsigned int, Node<Move>*>;
+    using typename SolverBase<Move, Ps...>::Workspace;
 
-    void search(TreeMap &trees, Game<Move> const &rootState) const
+    template<class G>
+    void search(TreeMap &trees, G const &rootState, Workspace &workspace) const
     {
         NodePtrMap roots;
         for (auto &pair : trees)
             roots.emplace(pair.first, pair.second.get());
-        auto randomState = rootState.cloneAndRandomise(rootState.currentPlayer());
-        select(roots, *randomState);
-        expand(roots, *randomState);
-        this->simulate(*randomState);
-        backPropagate(roots, *randomState);
+        auto &randomState = this->determinise(rootState, workspace);
+        auto &moves = workspace.moves;
+        select(roots, randomState, moves);
+        expand(roots, randomState, moves, workspace.untried);
+        this->simulate(randomState, moves, MOSolver::numPlayouts(), workspace, [this](auto &&f){
+            MOSolver::forEachPlayout(f);
+        });
+        backPropagate(roots, randomState, workspace);
+        for (auto &playout : workspace.playouts)
+            backPropagate(roots, *playout.state, workspace, 0);
+        this->endIteration(workspace);
     }
 
-    void select(NodePtrMap &nodes, Game<Move> &state) const
+    // The moves buffer holds the valid moves of the state after each step
+    template<class G>
+    void select(NodePtrMap &nodes, G &state, std::vector<Move> &moves) const
     {
-        auto const validMoves = state.validMoves();
-        auto const player = state.currentPlayer();
-        auto const &targetNode = nodes[player];
-        if (!MOSolver::selectNode(targetNode, validMoves)) {
-            auto const &move = this->selectChild(targetNode, state, validMoves)->move();
-            auto makeChild = [&move, &state]{ return MOSolver::newChild(move, state); };
-            for (auto &node : nodes)
-                node.second = node.second->findOrAddChild(move, makeChild);
-            state.doMove(move);
-            select(nodes, state);
+        state.fillValidMoves(moves);
+        while (!MOSolver::selectNode(nodes[state.currentPlayer()], moves)) {
+            auto const &move = this->selectChild(nodes[state.currentPlayer()], state, moves)->move();
+            descend(nodes, state, move);
+            state.fillValidMoves(moves);
         }
     }
 
-    void expand(NodePtrMap &nodes, Game<Move> &state) const
+    template<class G>
+    void expand(NodePtrMap &nodes, G &state, std::vector<Move> &moves, std::vector<Move> &untriedMoves) const
     {
-        auto const player = state.currentPlayer();
-        auto const untriedMoves = nodes[player]->untriedMoves(state.validMoves());
+        nodes[state.currentPlayer()]->untriedMoves(moves, untriedMoves);
+        // Another thread may have tried the remaining moves since the node was
+        // selected, in which case selection continues below it
+        while (untriedMoves.empty() && !moves.empty()) {
+            select(nodes, state, moves);
+            nodes[state.currentPlayer()]->untriedMoves(moves, untriedMoves);
+        }
         if (!untriedMoves.empty()) {
-            auto const move = randomElement(untriedMoves);
-            auto makeChild = [&move, &state]{ return MOSolver::newChild(move, state); };
-            for (auto &node : nodes)
-                node.second = node.second->findOrAddChild(move, makeChild);
-            state.doMove(move);
+            descend(nodes, state, randomElement(untriedMoves));
+            state.fillValidMoves(moves);
         }
     }
 
-    void static backPropagate(NodePtrMap &nodes, Game<Move> const &state)
+    // Move to the child corresponding to the given move in each tree
+    template<class G>
+    void descend(NodePtrMap &nodes, G &state, Move const &move) const
+    {
+        auto makeChild = [&]{ return this->newChild(move, state); };
+        for (auto &node : nodes) {
+            node.second = node.second->findOrAddChild(move, makeChild);
+            this->addVirtualLoss(node.second);
+        }
+        state.doMove(move);
+    }
+
+    void backPropagate(NodePtrMap &nodes, Game<Move> const &state, Workspace &workspace) const
+    {
+        backPropagate(nodes, state, workspace, this->virtualLoss());
+    }
+
+    void backPropagate(NodePtrMap &nodes, Game<Move> const &state, Workspace &workspace, unsigned int virtualLoss) const
     {
         for (auto node : nodes)
-            SolverBase<Move,Ps...>::backPropagate(node.second, state);
+            SolverBase<Move,Ps...>::backPropagate(node.second, state, workspace, virtualLoss);
     }
 
 private:
     TreeList m_trees;
+    bool m_reuseTrees {false};
+    unsigned int m_player {0};
 
-    TreeMap static newTree(POMGame<Move> const &state)
+    TreeMap newTree(POMGame<Move> const &state) const
     {
         TreeMap map;
         for (auto player : state.players())
-            map.emplace(player, MOSolver::newRoot(state));
+            map.emplace(player, this->newRoot(state));
         return map;
     }
 };
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2019 Steven Franzen <sfranzen85@gmail.com>
+ * This file is subject to the terms of the MIT License; see the LICENSE file in
+ * the root directory of this distribution.
+ */
+#ifndef ISMCTS_SCHEDULER_H
+#define ISMCTS_SCHEDULER_H
+
+#include "utility.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace ISMCTS
+{
+
+// Distributes a number of iterations among a set of workers. Each worker has
+// its own share, which it claims one iteration at a time without contending
+// with the others. A worker that has finished its share steals half of the
+// remaining iterations of another, so the workers finish at nearly the same
+// time even if their iterations take different amounts of time.
+class IterationScheduler
+{
+public:
+    IterationScheduler() = default;
+    IterationScheduler(IterationScheduler const &) = delete;
+    IterationScheduler &operator=(IterationScheduler const &) = delete;
+
+    // Must not be called while any worker is claiming iterations
+    void reset(std::size_t count, unsigned int numWorkers)
+    {
+        numWorkers = std::max(numWorkers, 1u);
+        if (numWorkers != m_numWorkers) {
+            allocateShares(numWorkers);
+            m_numWorkers = numWorkers;
+        }
+        for (unsigned int i = 0; i < numWorkers; ++i)
+            m_shares[i].remaining = count / numWorkers + (i < count % numWorkers);
+    }
+
+    // Claim an iteration for the given worker; returns false if none are left
+    bool claim(unsigned int worker)
+    {
+        auto &own = m_shares[worker % m_numWorkers].remaining;
+        while (decrement(own, std::size_t{1}) == 0) {
+            auto const stolen = steal(worker);
+            if (stolen == 0)
+                return false;
+            own += stolen;
+        }
+        return true;
+    }
+
+    std::size_t remaining() const
+    {
+        std::size_t total {0};
+        for (unsigned int i = 0; i < m_numWorkers; ++i)
+            total += m_shares[i].remaining;
+        return total;
+    }
+
+private:
+    std::size_t static constexpr s_cacheLine {64};
+
+    // Aligned to a cache line of its own, so that no two shares share one
+    struct alignas(s_cacheLine) Share
+    {
+        std::atomic_size_t remaining {0};
+    };
+
+    // Before C++17, new does not have to respect the alignment of an
+    // over-aligned type, so the shares are placed in storage aligned here
+    std::unique_ptr<char[]> m_storage;
+    Share *m_shares {nullptr};
+    unsigned int m_numWorkers {0};
+
+    void allocateShares(unsigned int numWorkers)
+    {
+        std::size_t space = (numWorkers + 1) * sizeof(Share);
+        m_storage.reset(new char[space]);
+        void *memory = m_storage.get();
+        std::align(alignof(Share), numWorkers * sizeof(Share), memory, space);
+        m_shares = static_cast<Share*>(memory);
+        for (unsigned int i = 0; i < numWorkers; ++i)
+            new (m_shares + i) Share;
+    }
+
+    std::size_t steal(unsigned int worker)
+    {
+        for (unsigned int i = 1; i < m_numWorkers; ++i) {
+            auto &victim = m_shares[(worker + i) % m_numWorkers].remaining;
+            auto const stolen = decrement(victim, (victim.load() + 1) / 2);
+            if (stolen > 0)
+                return stolen;
+        }
+        return 0;
+    }
+};
+
+// Call f for each iteration claimed by the worker, or until stop is set
+template<class Callable, class... Args>
+void executeFor(IterationScheduler &scheduler, unsigned int worker, std::atomic_bool const &stop,
+                Callable&& f, Args&&... args)
+{
+    while (!stop.load(std::memory_order_relaxed) && scheduler.claim(worker))
+        f(std::forward<Args>(args)...);
+}
+
+} // ISMCTS
+
+#endif // ISMCTS_SCHEDULER_H
@@ -8,9 +8,15 @@
 
 #include "config.h"
 #include "game.h"
+#include "tree/arena.h"
 #include "tree/node.h"
 
+#include <algorithm>
+#include <cassert>
 #include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace ISMCTS
@@ -25,6 +31,37 @@ public:
         m_config = Config(policies...);
     }
 
+    unsigned int virtualLoss() const
+    {
+        return m_virtualLoss;
+    }
+
+    // Set the number of virtual losses added to each node on the path of an
+    // iteration until its result is backpropagated; 0 disables virtual loss
+    void setVirtualLoss(unsigned int n)
+    {
+        m_virtualLoss = n;
+    }
+
+    unsigned int batchDepth() const
+    {
+        return m_batchDepth;
+    }
+
+    unsigned int batchSize() const
+    {
+        return m_batchSize;
+    }
+
+    // Let each thread collect the results for nodes up to the given depth below
+    // the root and add them once every batchSize iterations, so that threads
+    // sharing a tree contend less for its top nodes; depth 0 disables batching
+    void setBatchedUpdates(unsigned int depth, unsigned int batchSize = 32)
+    {
+        m_batchDepth = depth;
+        m_batchSize = std::max(batchSize, 1u);
+    }
+
 protected:
     using Base = SolverBase;
     using Config = ISMCTS::Config<Move, Ps...>;
@@ -33,29 +70,169 @@ protected:
     using SeqNode = typename Config::SeqTreePolicy::Node;
     using SimNode = typename Config::SimTreePolicy::Node;
 
-    void simulate(Game<Move> &state) const
+    // The state and valid moves of an additional playout of a leaf parallel
+    // iteration
+    struct Playout
     {
-        auto const moves = state.validMoves();
-        if (!moves.empty()) {
+        std::vector<Move> moves;
+        typename Game<Move>::Clone state;
+    };
+
+    // Data owned by a single search thread and reused between its iterations
+    struct Workspace
+    {
+        // The results collected for a node since the last flush
+        struct Batch
+        {
+            unsigned int count;
+            double total;
+        };
+
+        Workspace() = default;
+
+        // Copies start out empty, so that each determinises into its own state
+        Workspace(Workspace const &) {}
+
+        // A search thread destroys its workspace when it finishes
+        ~Workspace()
+        {
+            flush();
+        }
+
+        void flush()
+        {
+            for (auto const &pair : batches)
+                pair.first->update(pair.second.count, pair.second.total);
+            batches.clear();
+            iterations = 0;
+        }
+
+        std::vector<Move> moves;
+        std::vector<Move> untried;
+        typename Game<Move>::Clone state;
+        std::vector<Playout> playouts;
+        std::vector<Node<Move>*> path;
+        std::unordered_map<Node<Move>*, Batch> batches;
+        unsigned int iterations {0};
+    };
+
+    // The type of game state a search works with given the static type G of
+    // the root state. Calls to a final class need no virtual dispatch, but for
+    // other classes, cloneAndRandomise may return an object of a base class.
+    template<class G>
+    using SearchState = std::conditional_t<std::is_final<G>::value, G, Game<Move>>;
+
+    // Obtain a determinisation of the root state for the current player,
+    // reusing the workspace's state if the game supports it
+    template<class G>
+    G &determinise(G const &rootState, Workspace &workspace) const
+    {
+        return determinise(rootState, rootState.currentPlayer(), workspace.state);
+    }
+
+    template<class G>
+    G &determinise(G const &state, unsigned int observer, typename Game<Move>::Clone &target) const
+    {
+        if (!target || !state.randomiseInto(*target, observer))
+            target = state.cloneAndRandomise(observer);
+        assert(dynamic_cast<G*>(target.get()));
+        return static_cast<G&>(*target);
+    }
+
+    // Play out the game from the given state, of which moves holds the valid
+    // moves; the buffer is reused for the moves of every subsequent state
+    template<class G>
+    void simulate(G &state, std::vector<Move> &moves) const
+    {
+        while (!moves.empty()) {
             state.doMove(m_config.defaultPolicy(moves));
-            simulate(state);
+            state.fillValidMoves(moves);
         }
     }
 
-    void static backPropagate(Node<Move> *node, Game<Move> const &state)
+    // Play out the given state, and count - 1 other determinisations of it into
+    // the workspace's playouts, by calling forEachPlayout with the function
+    // performing playout i. The determinisations are made first, as the
+    // playouts modify the state. Games only determinise for the player to move,
+    // so they are made for the player to move in the given state; replaying the
+    // iteration's moves on new determinisations of the root state instead could
+    // fail, as the moves of other players need not be valid in these.
+    template<class G, class ForEach>
+    void simulate(G &state, std::vector<Move> &moves, unsigned int count, Workspace &workspace,
+                  ForEach &&forEachPlayout) const
+    {
+        if (count == 1)
+            return simulate(state, moves);
+        workspace.playouts.resize(count - 1);
+        auto const observer = state.currentPlayer();
+        for (auto &playout : workspace.playouts)
+            determinise(static_cast<G const &>(state), observer, playout.state).fillValidMoves(playout.moves);
+        forEachPlayout([&](unsigned int i){
+            if (i == 0)
+                return simulate(state, moves);
+            auto &playout = workspace.playouts[i - 1];
+            simulate(static_cast<G&>(*playout.state), playout.moves);
+        });
+    }
+
+    void backPropagate(Node<Move> *node, Game<Move> const &state, Workspace &workspace) const
+    {
+        backPropagate(node, state, workspace, m_virtualLoss);
+    }
+
+    // The additional playouts of a leaf parallel iteration have no virtual
+    // loss to remove
+    void backPropagate(Node<Move> *node, Game<Move> const &state, Workspace &workspace, unsigned int virtualLoss) const
     {
-        while (node) {
-            node->update(state);
-            node = node->parent();
+        if (m_batchDepth == 0) {
+            while (node) {
+                node->update(state, virtualLoss);
+                node = node->parent();
+            }
+            return;
         }
+        auto &path = workspace.path;
+        path.clear();
+        for (; node; node = node->parent())
+            path.push_back(node);
+
+        // The path ends at the root, which has depth 0
+        for (std::size_t i = 0, depth = path.size() - 1; i < path.size(); ++i, --depth) {
+            node = path[i];
+            if (depth == 0 || depth > m_batchDepth || !node->canBatchUpdates()) {
+                node->update(state, virtualLoss);
+            } else {
+                // Only the result waits for the flush, as a virtual loss left
+                // in place would count as one more visit without reward
+                auto &batch = workspace.batches[node];
+                ++batch.count;
+                batch.total += state.getResult(node->player());
+                if (virtualLoss > 0)
+                    node->removeVirtualLoss(virtualLoss);
+            }
+        }
+    }
+
+    // Called at the end of each iteration to add batched results when due
+    void endIteration(Workspace &workspace) const
+    {
+        if (m_batchDepth > 0 && ++workspace.iterations >= m_batchSize)
+            workspace.flush();
+    }
+
+    void addVirtualLoss(Node<Move> *node) const
+    {
+        if (m_virtualLoss > 0)
+            node->addVirtualLoss(m_virtualLoss);
     }
 
     bool static selectNode(Node<Move> const *node, std::vector<Move> const &moves)
     {
-        return moves.empty() || !node->untriedMoves(moves).empty();
+        return moves.empty() || node->hasUntriedMoves(moves);
     }
 
-    Node<Move> *selectChild(Node<Move> const *node, Game<Move> const &state, std::vector<Move> const &moves) const
+    template<class G>
+    Node<Move> *selectChild(Node<Move> const *node, G const &state, std::vector<Move> const &moves) const
     {
         if (state.currentMoveSimultaneous())
             return node->selectChild(moves, m_config.simTreePolicy);
@@ -63,24 +240,90 @@ protected:
             return node->selectChild(moves, m_config.seqTreePolicy);
     }
 
-    RootNode static newRoot(Game<Move> const &state)
+    // Start allocating nodes from a new arena, which is released once all trees
+    // using it have been destroyed
+    void newArena()
     {
-        if (state.currentMoveSimultaneous())
-            return std::make_shared<SimNode>();
-        else
-            return std::make_shared<SeqNode>();
+        m_arena = std::make_shared<NodeArena>();
     }
 
-    ChildNode static newChild(Move const &move, Game<Move> const &state)
+    // Discarded nodes are only released together with their arena, so one that
+    // is reused by search after search keeps growing. Trees are only worth
+    // keeping in it while they fill a reasonable part of the arena. Measuring
+    // them walks every node, so retainedBytes() is only called once the arena
+    // has grown large.
+    template<class Measure>
+    bool canReuseArena(Measure &&retainedBytes) const
     {
-        if (state.currentMoveSimultaneous())
-            return std::make_unique<SimNode>(move, state.currentPlayer());
-        else
-            return std::make_unique<SeqNode>(move, state.currentPlayer());
+        auto const capacity = m_arena ? m_arena->capacity() : 0;
+        return capacity <= s_maxUnusedArena || retainedBytes() * s_maxArenaGrowth >= capacity;
+    }
+
+    RootNode newRoot(Game<Move> const &state) const
+    {
+        return makeRoot(newNode(state));
+    }
+
+    // Replace the given tree by its subtree following the given moves, or by
+    // an empty pointer if it does not contain them
+    void advance(RootNode &root, std::vector<Move> const &moves) const
+    {
+        for (auto &move : moves) {
+            if (!root)
+                return;
+            auto child = root->removeChild(move);
+            root = child ? makeRoot(std::move(child)) : nullptr;
+        }
+    }
+
+    ChildNode newChild(Move const &move, Game<Move> const &state) const
+    {
+        return newNode(state, move, state.currentPlayer());
     }
 
 private:
     Config m_config;
+    std::size_t static constexpr s_maxUnusedArena {16 * 1024 * 1024};
+    std::size_t static constexpr s_maxArenaGrowth {8};
+
+    std::shared_ptr<NodeArena> m_arena;
+    unsigned int m_virtualLoss {0};
+    unsigned int m_batchDepth {0};
+    unsigned int m_batchSize {32};
+
+    // Nodes are allocated in the arena, which is kept alive by the root
+    RootNode makeRoot(ChildNode node) const
+    {
+        auto deleter = [arena = m_arena](Node<Move> *node){ typename Node<Move>::Deleter{}(node); };
+        return RootNode{node.release(), deleter};
+    }
+
+    template<class... Args>
+    ChildNode newNode(Game<Move> const &state, Args&&... args) const
+    {
+        if (state.currentMoveSimultaneous())
+            return createNode<SimNode>(m_config.simTreePolicy, std::forward<Args>(args)...);
+        else
+            return createNode<SeqNode>(m_config.seqTreePolicy, std::forward<Args>(args)...);
+    }
+
+    template<class T, class Policy, class... Args>
+    ChildNode createNode(Policy const &policy, Args&&... args) const
+    {
+        auto node = Node<Move>::template create<T>(*m_arena, std::forward<Args>(args)...);
+        initialise(policy, static_cast<T&>(*node), 0);
+        return node;
+    }
+
+    // Let the policy set up a new node if it has a member initialise(Node&)
+    template<class Policy, class T>
+    auto static initialise(Policy const &policy, T &node, int) -> decltype(policy.initialise(node), void())
+    {
+        policy.initialise(node);
+    }
+
+    template<class Policy, class T>
+    void static initialise(Policy const &, T &, long) {}
 };
 
 } // ISMCTS
@@ -12,7 +12,11 @@
 #include "solverbase.h"
 #include "utility.h"
 
+#include <algorithm>
+#include <iterator>
 #include <memory>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 namespace ISMCTS
@@ -27,12 +31,93 @@ public:
     using RootNode = typename Config::RootNode;
     using TreeList = typename Config::TreeList;
 
-    Move operator()(Game<Move> const &rootState)
+    ~SOSolver()
     {
-        auto treeGenerator = [&rootState]{ return SOSolver::newRoot(rootState); };
-        auto treeSearch = [this](RootNode &root, Game<Move> const &state){ search(root.get(), state); };
-        m_trees = SOSolver::execute(treeSearch, treeGenerator, rootState);
-        return SOSolver::template bestMove<Move>(m_trees);
+        SOSolver::cancel();
+    }
+
+    // If the root state is an instance of a final class, the search is compiled
+    // for that class, so that calls to its functions need no virtual dispatch
+    template<class G>
+    Move operator()(G const &rootState)
+    {
+        start(rootState);
+        return wait();
+    }
+
+    // Start searching from the given state without waiting for the result. The
+    // state must remain valid until the search has finished.
+    template<class G>
+    void start(G const &rootState)
+    {
+        static_assert(std::is_base_of<Game<Move>, G>::value, "G must implement Game<Move>");
+        using State = typename SOSolver::template SearchState<G>;
+        SOSolver::stop();
+        SOSolver::join();
+        auto treeGenerator = [&]{ return this->newRoot(rootState); };
+        if (m_reuseTrees) {
+            for (auto &tree : m_trees) {
+                if (!tree)
+                    tree = treeGenerator();
+            }
+            m_reuseTrees = false;
+        } else {
+            this->newArena();
+            m_trees = SOSolver::makeTrees(treeGenerator);
+        }
+        auto treeSearch = [this, workspace = Workspace{}](RootNode &root, State const &state) mutable {
+            search(root.get(), state, workspace);
+        };
+        typename SOSolver::JoinGuard guard {*this};
+        SOSolver::execute(treeSearch, m_trees, rootState);
+        guard.dismiss();
+    }
+
+    // Wait until the current search has finished and return its result. Throws
+    // std::runtime_error if it was stopped before finding any move.
+    Move wait()
+    {
+        SOSolver::join();
+        return currentBestMove();
+    }
+
+    // Whether the trees of the current search hold a move to return
+    bool hasBestMove() const
+    {
+        return std::any_of(m_trees.begin(), m_trees.end(), [](auto const &tree){
+            return tree && !tree->children().empty();
+        });
+    }
+
+    // The best move according to the statistics gathered so far, which may be
+    // queried while the search is running if hasBestMove() returns true
+    Move currentBestMove() const
+    {
+        if (!hasBestMove())
+            throw std::runtime_error{"The search has not found a move"};
+        // Trees discarded by advanceTrees are empty pointers
+        TreeList trees;
+        std::copy_if(m_trees.begin(), m_trees.end(), std::back_inserter(trees), [](auto const &tree){ return bool(tree); });
+        return SOSolver::template bestMove<Move>(trees);
+    }
+
+    // Keep the current trees for the next search, which should start from the
+    // state reached by playing the given moves. Requires a finished search;
+    // returns false if there was none, or if any of the trees did not contain
+    // these moves, in which case such trees are discarded. The next search
+    // starts afresh instead if the kept trees are small compared to the memory
+    // held by their arena.
+    bool advanceTrees(std::vector<Move> const &moves)
+    {
+        if (m_trees.empty())
+            return false;
+        for (auto &tree : m_trees)
+            this->advance(tree, moves);
+        m_reuseTrees = std::any_of(m_trees.begin(), m_trees.end(), [](auto const &tree){ return bool(tree); })
+            && this->canReuseArena([this]{
+                return sum(m_trees, [](auto const &tree){ return tree ? tree->treeMemoryUsage() : std::size_t{0}; });
+            });
+        return std::all_of(m_trees.begin(), m_trees.end(), [](auto const &tree){ return bool(tree); });
     }
 
     TreeList currentTrees() const
@@ -41,37 +126,59 @@ public:
     }
 
 protected:
-    void search(Node<Move> *rootNode, Game<Move> const &rootState) const
+    using typename SolverBase<Move, Ps...>::Workspace;
+
+    template<class G>
+    void search(Node<Move> *rootNode, G const &rootState, Workspace &workspace) const
     {
-        auto randomState = rootState.cloneAndRandomise(rootState.currentPlayer());
-        select(rootNode, *randomState);
-        expand(rootNode, *randomState);
-        this->simulate(*randomState);
-        SOSolver::backPropagate(rootNode, *randomState);
+        auto &randomState = this->determinise(rootState, workspace);
+        auto &moves = workspace.moves;
+        select(rootNode, randomState, moves);
+        expand(rootNode, randomState, moves, workspace.untried);
+        this->simulate(randomState, moves, SOSolver::numPlayouts(), workspace, [this](auto &&f){
+            SOSolver::forEachPlayout(f);
+        });
+        this->backPropagate(rootNode, randomState, workspace);
+        for (auto &playout : workspace.playouts)
+            this->backPropagate(rootNode, *playout.state, workspace, 0);
+        this->endIteration(workspace);
     }
 
-    void select(Node<Move> *&node, Game<Move> &state) const
+    // The moves buffer holds the valid moves of the state after each step
+    template<class G>
+    void select(Node<Move> *&node, G &state, std::vector<Move> &moves) const
     {
-        auto const validMoves = state.validMoves();
-        if (!SOSolver::selectNode(node, validMoves)) {
-            node = this->selectChild(node, state, validMoves);
+        state.fillValidMoves(moves);
+        while (!SOSolver::selectNode(node, moves)) {
+            node = this->selectChild(node, state, moves);
+            this->addVirtualLoss(node);
             state.doMove(node->move());
-            select(node, state);
+            state.fillValidMoves(moves);
         }
     }
 
-    void expand(Node<Move> *&node, Game<Move> &state) const
+    template<class G>
+    void expand(Node<Move> *&node, G &state, std::vector<Move> &moves, std::vector<Move> &untriedMoves) const
     {
-        auto const untriedMoves = node->untriedMoves(state.validMoves());
+        node->untriedMoves(moves, untriedMoves);
+        // Another thread may have tried the remaining moves since the node was
+        // selected, in which case selection continues below it
+        while (untriedMoves.empty() && !moves.empty()) {
+            select(node, state, moves);
+            node->untriedMoves(moves, untriedMoves);
+        }
         if (!untriedMoves.empty()) {
             auto const &move = randomElement(untriedMoves);
-            node = node->addChild(SOSolver::newChild(move, state));
+            node = node->findOrAddChild(move, [&]{ return this->newChild(move, state); });
+            this->addVirtualLoss(node);
             state.doMove(move);
+            state.fillValidMoves(moves);
         }
     }
 
 private:
     TreeList m_trees;
+    bool m_reuseTrees {false};
 };
 
 } // ISMCTS
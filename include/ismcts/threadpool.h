@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 Steven Franzen <sfranzen85@gmail.com>
+ * This file is subject to the terms of the MIT License; see the LICENSE file in
+ * the root directory of this distribution.
+ */
+#ifndef ISMCTS_THREADPOOL_H
+#define ISMCTS_THREADPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ISMCTS
+{
+
+// A fixed set of long-lived worker threads executing tasks in order of
+// submission. Tasks should not wait on each other, since there is no guarantee
+// that they run concurrently.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int numThreads = std::thread::hardware_concurrency())
+    {
+        numThreads = std::max(numThreads, 1u);
+        m_workers.reserve(numThreads);
+        for (unsigned int i = 0; i < numThreads; ++i)
+            m_workers.emplace_back([this]{ work(); });
+    }
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    // Finishes all pending tasks before joining the workers
+    ~ThreadPool()
+    {
+        {
+            Lock lock {m_mutex};
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        for (auto &worker : m_workers)
+            worker.join();
+    }
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(m_workers.size());
+    }
+
+    template<class Callable>
+    std::future<void> submit(Callable &&f)
+    {
+        std::packaged_task<void()> task {std::forward<Callable>(f)};
+        auto future = task.get_future();
+        {
+            Lock lock {m_mutex};
+            m_tasks.emplace_back(std::move(task));
+        }
+        m_condition.notify_one();
+        return future;
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::packaged_task<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping {false};
+
+    void work()
+    {
+        while (true) {
+            std::packaged_task<void()> task;
+            {
+                Lock lock {m_mutex};
+                m_condition.wait(lock, [this]{ return m_stopping || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                    return;
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+} // ISMCTS
+
+#endif // ISMCTS_THREADPOOL_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019 Steven Franzen <sfranzen85@gmail.com>
+ * This file is subject to the terms of the MIT License; see the LICENSE file in
+ * the root directory of this distribution.
+ */
+#ifndef ISMCTS_ARENA_H
+#define ISMCTS_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace ISMCTS
+{
+
+/*
+ * Memory arena for the nodes of one or more search trees and their child lists.
+ * Memory is handed out from large blocks, where each thread allocates from a
+ * block of its own, so that concurrent allocation only synchronises when a
+ * thread needs a new block.
+ * Objects created in the arena must be destroyed by calling their destructor;
+ * the memory itself is only released all at once, when the arena is destroyed.
+ */
+class NodeArena
+{
+public:
+    explicit NodeArena(std::size_t blockSize = 64 * 1024)
+        : m_blockSize{blockSize}
+        , m_id{nextId()}
+    {}
+
+    NodeArena(NodeArena const &) = delete;
+    NodeArena &operator=(NodeArena const &) = delete;
+
+    template<class T, class... Args>
+    T *create(Args&&... args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Raw memory for objects that are constructed and destroyed by the caller
+    void *allocate(std::size_t size, std::size_t alignment)
+    {
+        auto &c = cursor();
+        if (c.arena != m_id || !std::align(alignment, size, c.position, c.space)) {
+            newBlock(c, size + alignment);
+            std::align(alignment, size, c.position, c.space);
+        }
+        auto const result = c.position;
+        c.position = static_cast<char*>(c.position) + size;
+        c.space -= size;
+        return result;
+    }
+
+    // The number of bytes reserved by the arena
+    std::size_t capacity() const
+    {
+        Lock lock {m_mutex};
+        return m_capacity;
+    }
+
+private:
+    using Lock = std::lock_guard<std::mutex>;
+
+    // A thread's position in the block it is currently allocating from
+    struct Cursor
+    {
+        std::uint64_t arena {0};
+        void *position {nullptr};
+        std::size_t space {0};
+    };
+
+    std::size_t const m_blockSize;
+    std::uint64_t const m_id;
+    std::mutex mutable m_mutex;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    std::size_t m_capacity {0};
+
+    std::uint64_t static nextId()
+    {
+        std::atomic<std::uint64_t> static counter {0};
+        return ++counter;
+    }
+
+    Cursor static &cursor()
+    {
+        Cursor thread_local static cursor;
+        return cursor;
+    }
+
+    void newBlock(Cursor &c, std::size_t minSize)
+    {
+        auto const size = std::max(m_blockSize, minSize);
+        Lock lock {m_mutex};
+        m_blocks.emplace_back(new char[size]);
+        m_capacity += size;
+        c.arena = m_id;
+        c.position = m_blocks.back().get();
+        c.space = size;
+    }
+};
+
+} // ISMCTS
+
+#endif // ISMCTS_ARENA_H
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2019 Steven Franzen <sfranzen85@gmail.com>
+ * This file is subject to the terms of the MIT License; see the LICENSE file in
+ * the root directory of this distribution.
+ */
+#ifndef ISMCTS_CHILDLIST_H
+#define ISMCTS_CHILDLIST_H
+
+#include "arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace ISMCTS
+{
+
+/*
+ * List supporting one writer appending elements concurrently with any number of
+ * readers. Elements are stored in a chain of segments of doubling capacity, so
+ * they do not move when others are added; an element becomes visible to
+ * readers only after it has been fully written, by publishing the new size.
+ * Appending must be serialised by the caller, but reading requires no
+ * synchronisation. Segments are allocated from the arena passed to push_back,
+ * if any, and otherwise on the heap.
+ */
+template<class T>
+class ChildList
+{
+    // The items are stored directly after the segment
+    struct Segment
+    {
+        Segment(T *items, std::size_t capacity, bool inArena)
+            : items{items}
+            , capacity{capacity}
+            , inArena{inArena}
+        {}
+
+        T *const items;
+        std::size_t const capacity;
+        bool const inArena;
+        std::atomic<Segment*> next {nullptr};
+    };
+
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T const *;
+        using reference = T const &;
+
+        const_iterator() = default;
+
+        reference operator*() const { return segment()->items[m_offset]; }
+        pointer operator->() const { return &**this; }
+
+        const_iterator &operator++()
+        {
+            ++m_index;
+            auto const current = segment();
+            if (++m_offset == current->capacity) {
+                m_link = &current->next;
+                m_offset = 0;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            auto const old = *this;
+            ++*this;
+            return old;
+        }
+
+        const_iterator &operator+=(difference_type n)
+        {
+            while (n-- > 0)
+                ++*this;
+            return *this;
+        }
+
+        friend const_iterator operator+(const_iterator it, difference_type n) { return it += n; }
+        friend difference_type operator-(const_iterator const &a, const_iterator const &b) { return a.m_index - b.m_index; }
+        friend bool operator==(const_iterator const &a, const_iterator const &b) { return a.m_index == b.m_index; }
+        friend bool operator!=(const_iterator const &a, const_iterator const &b) { return a.m_index != b.m_index; }
+        friend bool operator<(const_iterator const &a, const_iterator const &b) { return a.m_index < b.m_index; }
+
+    private:
+        friend class ChildList;
+
+        // The link to the current segment is only followed when an element is
+        // accessed, since the segment may not exist yet when the iterator is
+        // created; an element is only reachable after its segment was linked.
+        std::atomic<Segment*> const *m_link {nullptr};
+        std::size_t m_offset {0};
+        difference_type m_index {0};
+
+        const_iterator(std::atomic<Segment*> const *link, difference_type index)
+            : m_link{link}
+            , m_index{index}
+        {}
+
+        Segment const *segment() const { return m_link->load(std::memory_order_acquire); }
+    };
+
+    using value_type = T;
+    using size_type = std::size_t;
+    using iterator = const_iterator;
+
+    ChildList() = default;
+    ChildList(ChildList const &) = delete;
+    ChildList &operator=(ChildList const &) = delete;
+
+    ~ChildList()
+    {
+        auto segment = m_head.load(std::memory_order_relaxed);
+        while (segment) {
+            auto const next = segment->next.load(std::memory_order_relaxed);
+            destroySegment(segment);
+            segment = next;
+        }
+    }
+
+    size_type size() const { return m_size.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+    // The number of bytes allocated for elements, whether used or not
+    std::size_t memoryUsage() const
+    {
+        std::size_t bytes {0};
+        for (auto s = m_head.load(std::memory_order_acquire); s; s = s->next.load(std::memory_order_acquire))
+            bytes += sizeof(Segment) + s->capacity * sizeof(T);
+        return bytes;
+    }
+
+    // Iteration covers the elements published when end() is called, whether
+    // begin() was called before or after it
+    const_iterator begin() const { return {&m_head, 0}; }
+    const_iterator end() const { return {nullptr, static_cast<std::ptrdiff_t>(size())}; }
+
+    T const &operator[](size_type i) const { return *(begin() + i); }
+    T const &front() const { return (*this)[0]; }
+    T const &back() const { return (*this)[size() - 1]; }
+
+    // Append an element, allocating any new segment from the given arena,
+    // which must outlive the list; calls must be serialised
+    T const &push_back(T item, NodeArena *arena = nullptr)
+    {
+        Count const n = m_size.load(std::memory_order_relaxed);
+        if (!m_tail) {
+            m_tail = newSegment(s_initialCapacity, arena);
+            m_head.store(m_tail, std::memory_order_release);
+        } else if (n - m_tailStart == m_tail->capacity) {
+            auto segment = m_tail->next.load(std::memory_order_relaxed);
+            if (!segment) {
+                segment = newSegment(2 * m_tail->capacity, arena);
+                m_tail->next.store(segment, std::memory_order_release);
+            }
+            m_tailStart += m_tail->capacity;
+            m_tail = segment;
+        }
+        auto &slot = m_tail->items[n - m_tailStart];
+        slot = std::move(item);
+        m_size.store(n + 1, std::memory_order_release);
+        return slot;
+    }
+
+    // Remove and return an element, moving the ones after it forward. This
+    // requires exclusive access to the list.
+    T remove(size_type i)
+    {
+        Count const n = m_size.load(std::memory_order_relaxed);
+        T item = std::move(slot(i));
+        for (; i + 1 < n; ++i)
+            slot(i) = std::move(slot(i + 1));
+        m_size.store(n - 1, std::memory_order_release);
+
+        // Point the writer at the segment receiving the next element
+        m_tail = m_head.load(std::memory_order_relaxed);
+        m_tailStart = 0;
+        while (n - 1 - m_tailStart > m_tail->capacity) {
+            m_tailStart += m_tail->capacity;
+            m_tail = m_tail->next.load(std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+private:
+    // Sizes are stored in 32 bits to keep nodes small
+    using Count = std::uint32_t;
+
+    std::size_t static constexpr s_initialCapacity {8};
+
+    std::atomic<Segment*> m_head {nullptr};
+
+    // Only accessed by the writer
+    Segment *m_tail {nullptr};
+    Count m_tailStart {0};
+
+    std::atomic<Count> m_size {0};
+
+    std::size_t static constexpr s_itemsOffset {(sizeof(Segment) + alignof(T) - 1) / alignof(T) * alignof(T)};
+
+    Segment static *newSegment(std::size_t capacity, NodeArena *arena)
+    {
+        auto const size = s_itemsOffset + capacity * sizeof(T);
+        auto const memory = arena ? arena->allocate(size, std::max(alignof(Segment), alignof(T))) : ::operator new(size);
+        auto const items = reinterpret_cast<T*>(static_cast<char*>(memory) + s_itemsOffset);
+        for (std::size_t i = 0; i < capacity; ++i)
+            new (items + i) T();
+        return new (memory) Segment{items, capacity, arena != nullptr};
+    }
+
+    void static destroySegment(Segment *segment)
+    {
+        for (std::size_t i = 0; i < segment->capacity; ++i)
+            segment->items[i].~T();
+        auto const inArena = segment->inArena;
+        segment->~Segment();
+        if (!inArena)
+            ::operator delete(segment);
+    }
+
+    T &slot(size_type i)
+    {
+        auto segment = m_head.load(std::memory_order_relaxed);
+        while (i >= segment->capacity) {
+            i -= segment->capacity;
+            segment = segment->next.load(std::memory_order_relaxed);
+        }
+        return segment->items[i];
+    }
+};
+
+} // ISMCTS
+
+#endif // ISMCTS_CHILDLIST_H
@@ -11,91 +11,122 @@
 
 #include <algorithm>
 #include <cmath>
-#include <mutex>
+#include <memory>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 namespace ISMCTS
 {
 
-// Helper class that precomputes positive integer powers of a given base
+// Table of the positive integer powers of a given base up to some maximum, with
+// larger powers computed on demand. It is immutable after construction, so it
+// can be shared by any number of threads.
 template<typename T>
 class PositiveIntegerPowers
 {
 public:
-    explicit PositiveIntegerPowers(std::size_t max)
-        : m_powers(max + 1, T{1})
-    {}
-
-    T operator()(T base, std::size_t power)
+    explicit PositiveIntegerPowers(T base, std::size_t max = 2000)
+        : m_base{base}
+        , m_powers(max + 1)
     {
-        if (base != m_base)
-            fill(base);
-
-        if (power >= m_powers.size())
-            resize(power);
-
-        return m_powers[power];
+        for (std::size_t i = 0; i < m_powers.size(); ++i)
+            m_powers[i] = std::pow(base, i);
     }
 
-private:
-    std::vector<T> m_powers;
-    T m_base {0};
+    T base() const { return m_base; }
 
-    void fill(T base, std::size_t start = 0)
+    T operator()(std::size_t power) const
     {
-        m_base = base;
-        for (std::size_t i = start; i < m_powers.size(); ++i)
-            m_powers[i] = std::pow(base, i);
+        return power < m_powers.size() ? m_powers[power] : std::pow(m_base, power);
     }
 
-    void resize(std::size_t power)
-    {
-        auto const oldSize = m_powers.size();
-        m_powers.resize(power * 2);
-        fill(m_base, oldSize);
-    }
+private:
+    T const m_base;
+    std::vector<T> m_powers;
 };
 
 // Discounted UCB
+//
+// The node keeps the discounted sums as of its most recent update, which only
+// need to be multiplied by one more power of the discount factor gamma to
+// obtain the current sums. Results received before gamma is known are kept
+// until it is set, either by the policy when the node is created or by the
+// first call to discountSums. The powers of gamma are taken from a table
+// shared with the policy.
 template<class Move>
 class D_UCBNode : public UCBNode<Move>
 {
 public:
     using UCBNode<Move>::UCBNode;
     using ResultType = std::tuple<double,double>;
+    using Powers = std::shared_ptr<PositiveIntegerPowers<double> const>;
+
+    void setDiscount(Powers powers)
+    {
+        Lock lock {this->mutex()};
+        bind(std::move(powers));
+    }
+
+    // The powers argument only takes effect if the discount was not yet set
+    ResultType discountSums(Powers const &powers) const
+    {
+        Lock lock {this->mutex()};
+        if (!m_powers)
+            bind(powers);
+        if (m_N == 0)
+            return ResultType{0, 0};
+        auto const discount = (*m_powers)(this->available() - m_trial);
+        return std::make_tuple(m_N * discount, m_X * discount);
+    }
 
-    ResultType discountSums(double gamma) const
+    std::size_t memoryUsage() const override
     {
-        double N {0}, X {0};
         Lock lock {this->mutex()};
-        auto const t = this->available();
-        auto r = m_results.begin();
-        for (auto s = m_trials.begin(); s != m_trials.end(); ++s, ++r) {
-            auto const discount = s_powers(gamma, t - *s);
-            N += discount;
-            X += discount * *r;
-        }
-        return std::make_tuple(N, X);
+        return UCBNode<Move>::memoryUsage() + sizeof(D_UCBNode) - sizeof(UCBNode<Move>)
+            + m_pending.capacity() * sizeof(Result);
     }
 
+    // The discounted sums depend on the trial number of each result
+    bool canBatchUpdates() const override { return false; }
+
 private:
     using typename UCBNode<Move>::Lock;
+    using Result = std::pair<unsigned, double>;
 
-    PositiveIntegerPowers<double> static s_powers;
-    std::vector<double> m_results;
-    std::vector<unsigned> m_trials;
+    Powers mutable m_powers;
+    double mutable m_N {0};
+    double mutable m_X {0};
+    unsigned mutable m_trial {0};
+    std::vector<Result> mutable m_pending;
 
     void updateData(Game<Move> const &terminalState) override
     {
         Lock lock {this->mutex()};
-        m_trials.emplace_back(this->available());
-        m_results.emplace_back(terminalState.getResult(this->player()));
+        Result const result {this->available(), terminalState.getResult(this->player())};
+        if (m_powers)
+            add(result);
+        else
+            m_pending.emplace_back(result);
     }
-};
 
-template<class Move>
-PositiveIntegerPowers<double> D_UCBNode<Move>::s_powers {2000};
+    // Mutex assumed locked
+    void bind(Powers powers) const
+    {
+        m_powers = std::move(powers);
+        for (auto const &result : m_pending)
+            add(result);
+        std::vector<Result>{}.swap(m_pending);
+    }
+
+    void add(Result const &result) const
+    {
+        auto const discount = m_N > 0 ? (*m_powers)(result.first - m_trial) : 0;
+        m_N = m_N * discount + 1;
+        m_X = m_X * discount + result.second;
+        m_trial = result.first;
+    }
+};
 
 template<class Move>
 struct D_UCB : public UCB1<Move>
@@ -104,9 +135,17 @@ struct D_UCB : public UCB1<Move>
 
     explicit D_UCB(double exploration = 0.7, double gamma = 0.8)
         : UCB1<Move>{exploration}
-        , m_gamma{gamma}
+        , m_powers{std::make_shared<PositiveIntegerPowers<double> const>(gamma)}
     {}
 
+    double gamma() const { return m_powers->base(); }
+
+    // Called by the solvers for each new node
+    void initialise(Node &node) const
+    {
+        node.setDiscount(m_powers);
+    }
+
     Node *operator()(std::vector<Node*> const &nodes) const
     {
         using Result = typename Node::ResultType;
@@ -115,7 +154,11 @@ struct D_UCB : public UCB1<Move>
             node->markAvailable();
 
         std::vector<Result> results(nodes.size());
-        std::transform(nodes.begin(), nodes.end(), results.begin(), [=](Node const *node){ return node->discountSums(m_gamma); });
+        std::transform(nodes.begin(), nodes.end(), results.begin(), [=](Node const *node){
+            auto sums = node->discountSums(m_powers);
+            std::get<0>(sums) += node->virtualLoss();
+            return sums;
+        });
 
         auto const n = sum(results, [](Result const &r){ return std::get<0>(r); });
         std::vector<double> ucbScores(nodes.size());
@@ -130,7 +173,8 @@ struct D_UCB : public UCB1<Move>
     }
 
 private:
-    double m_gamma;
+    // Shared by copies of the policy and their nodes
+    typename Node::Powers m_powers;
 };
 
 } // ISMCTS
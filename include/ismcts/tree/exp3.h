@@ -10,9 +10,11 @@
 #include "../game.h"
 #include "../utility.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <iomanip>
+#include <numeric>
 #include <random>
 #include <sstream>
 #include <vector>
@@ -30,17 +32,22 @@ public:
     void setProbability(double p) { m_probability = p; }
     double score() const { return m_score; }
 
+    std::size_t memoryUsage() const override
+    {
+        return Node<Move>::memoryUsage() + sizeof(EXPNode) - sizeof(Node<Move>);
+    }
+
     operator std::string() const override
     {
         std::ostringstream oss;
         oss << "[M:" << this->move() << " by " << this->player() << ", V/S/P: " << std::fixed << std::setprecision(1);
-        oss << this->visits() << "/" << m_score << "/" << std::setprecision(2) << m_probability << "]";
+        oss << this->visits() << "/" << double(m_score) << "/" << std::setprecision(2) << m_probability << "]";
         return oss.str();
     }
 
 private:
     std::atomic<double> m_probability {1};
-    std::atomic<double> m_score {0};
+    AtomicFixedPoint<> m_score {0};
 
     void updateData(Game<Move> const &terminalState) override
     {
@@ -56,9 +63,13 @@ public:
 
     Node *operator()(std::vector<Node*> const &nodes) const
     {
-        auto const weights = probabilities(nodes);
-        std::discrete_distribution<std::size_t> dist {weights.begin(), weights.end()};
-        return nodes[dist(prng())];
+        // Sample from the cumulative probabilities
+        auto &weights = threadBuffer<double>();
+        probabilities(nodes, weights);
+        std::partial_sum(weights.begin(), weights.end(), weights.begin());
+        std::uniform_real_distribution<double> dist {0, weights.back()};
+        auto const i = std::upper_bound(weights.begin(), weights.end(), dist(prng())) - weights.begin();
+        return nodes[std::min<std::size_t>(i, nodes.size() - 1)];
     }
 
 private:
@@ -70,22 +81,29 @@ private:
      * given nodes as the trial counter variable t, because the number of trials
      * varies with the set of nodes.
      */
-    std::vector<double> static probabilities(std::vector<Node*> const &nodes)
+    void static probabilities(std::vector<Node*> const &nodes, std::vector<double> &p)
     {
         auto const K = nodes.size();
         auto const t = sum(nodes, [](Node const *node){ return node->visits(); });
         auto const e_t = epsilon(K, t);
         auto const e_tm1 = epsilon(K, t - 1);
-        auto const expSum = sum(nodes, [=](Node const *node){ return std::exp(e_tm1 * node->score()); });
-
-        std::vector<double> probabilities(K);
-        std::transform(nodes.begin(), nodes.end(), probabilities.begin(), [=](Node *node){
-            auto const p = e_t + (1 - K * e_t) * std::exp(e_tm1 * node->score()) / expSum;
-            node->setProbability(p);
-            return p;
-        });
 
-        return probabilities;
+        // Each exponential is evaluated once, relative to the largest one to
+        // avoid overflow; the offset cancels out in the normalisation
+        p.resize(K);
+        std::transform(nodes.begin(), nodes.end(), p.begin(), [=](Node const *node){ return e_tm1 * node->score(); });
+        auto const max = *std::max_element(p.begin(), p.end());
+        double expSum {0};
+        for (auto &x : p) {
+            x = std::exp(x - max);
+            expSum += x;
+        }
+
+        auto const factor = (1 - K * e_t) / expSum;
+        for (std::size_t i = 0; i < K; ++i) {
+            p[i] = e_t + factor * p[i];
+            nodes[i]->setProbability(p[i]);
+        }
     }
 
     // The epsilon factor or exploration rate
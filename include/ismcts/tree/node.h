@@ -6,12 +6,20 @@
 #ifndef ISMCTS_NODE_H
 #define ISMCTS_NODE_H
 
+#include "arena.h"
+#include "childlist.h"
+#include "spinlock.h"
+#include "../utility.h"
+
 #include <algorithm>
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <numeric>
 #include <ostream>
+#include <type_traits>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace ISMCTS
@@ -24,7 +32,25 @@ template<class Move>
 class Node
 {
 public:
-    using ChildPtr = std::unique_ptr<Node>;
+    // Deletes heap allocated nodes and only destroys those created in an arena
+    struct Deleter
+    {
+        Deleter() = default;
+
+        template<class T>
+        Deleter(std::default_delete<T>) {}
+
+        void operator()(Node *node) const
+        {
+            if (node->m_arena)
+                node->~Node();
+            else
+                delete node;
+        }
+    };
+
+    using ChildPtr = std::unique_ptr<Node, Deleter>;
+    using ChildList = ISMCTS::ChildList<ChildPtr>;
 
     explicit Node(Move const &move = {}, unsigned int player = 0)
         : m_move{move}
@@ -33,11 +59,22 @@ public:
 
     virtual ~Node() = default;
 
+    // Create a node of type T in the given arena, which must outlive it. The
+    // node's child list is allocated from the same arena.
+    template<class T, class... Args>
+    ChildPtr static create(NodeArena &arena, Args&&... args)
+    {
+        Node *node = arena.create<T>(std::forward<Args>(args)...);
+        node->m_arena = &arena;
+        return ChildPtr{node};
+    }
+
     Node *parent() const { return m_parent; }
-    std::vector<ChildPtr> const &children() const { return m_children; }
+    ChildList const &children() const { return m_children; }
     Move const &move() const { return m_move; }
     unsigned int player() const { return m_playerJustMoved; }
     unsigned int visits() const { return m_visits; }
+    unsigned int virtualLoss() const { return m_virtualLoss; }
     std::size_t depth() const { return depth(0); }
     std::size_t height() const { return height(0); }
 
@@ -49,47 +86,124 @@ public:
 
     template<class Generator>
     Node *findOrAddChild(Move const &move, Generator &&g)
+    {
+        // Search without locking first, then only the children added since
+        auto const size = m_children.size();
+        auto child = findChild(move, m_children.begin(), size);
+        if (child)
+            return child;
+        Lock lock {m_mutex};
+        child = findChild(move, m_children.begin() + size, m_children.size() - size);
+        return child ? child : addChildLocked(g());
+    }
+
+    // Detach and return the child with the given move, or an empty pointer if
+    // there is none. Must not be called concurrently with other functions.
+    ChildPtr removeChild(Move const &move)
     {
         Lock lock {m_mutex};
         auto const pos = std::find_if(m_children.begin(), m_children.end(), [&](auto const &c){ return c->m_move == move; });
-        return pos < m_children.end() ? pos->get() : addChildLocked(g());
+        if (pos == m_children.end())
+            return nullptr;
+        auto child = m_children.remove(pos - m_children.begin());
+        child->m_parent = nullptr;
+        return child;
     }
 
     template<class Policy>
     Node *selectChild(std::vector<Move> const &legalMoves, Policy &policy) const
     {
         using Type = typename Policy::Node;
-        std::vector<Type*> legalChildren;
-        legalChildren.reserve(legalMoves.size());
-        {
-            Lock lock {m_mutex};
-            for (auto &c : m_children) {
-                if (std::any_of(legalMoves.begin(), legalMoves.end(), [&](Move const &move){ return c->m_move == move; }))
-                    legalChildren.emplace_back(static_cast<Type*>(c.get()));
-            }
-        }
+        auto &legalChildren = threadBuffer<Type*>();
+        legalChildren.clear();
+        forEachLegalChild(legalMoves, [&](std::size_t, Node *c){
+            legalChildren.emplace_back(static_cast<Type*>(c));
+        });
         return policy(legalChildren);
     }
 
-    virtual void update(Game<Move> const &terminalState) final
+    // Count the given number of losses until they are removed by update(), to
+    // steer other threads away from this node while it is being searched
+    void addVirtualLoss(unsigned int n)
+    {
+        m_virtualLoss += n;
+    }
+
+    // Remove virtual losses without recording a result, for an iteration whose
+    // result is added to the node later
+    void removeVirtualLoss(unsigned int n)
+    {
+        m_virtualLoss -= n;
+    }
+
+    virtual void update(Game<Move> const &terminalState, unsigned int virtualLoss = 0) final
     {
         if (this->parent()) {
             ++m_visits;
             updateData(terminalState);
+            if (virtualLoss > 0)
+                m_virtualLoss -= virtualLoss;
         }
     }
 
+    // Record count results at once, given their sum for this node's player;
+    // only supported if canBatchUpdates() returns true
+    virtual void update(unsigned int count, double totalResult, unsigned int virtualLoss = 0) final
+    {
+        if (this->parent()) {
+            m_visits += count;
+            addResults(count, totalResult);
+            if (virtualLoss > 0)
+                m_virtualLoss -= virtualLoss;
+        }
+    }
+
+    // Whether the node's statistics only depend on the number and sum of its
+    // results, so that these can be added in batches
+    virtual bool canBatchUpdates() const { return false; }
+
     std::vector<Move> untriedMoves(std::vector<Move> const &legalMoves) const
     {
         std::vector<Move> untried;
-        untried.reserve(legalMoves.size());
-        Lock lock {m_mutex};
-        std::copy_if(legalMoves.begin(), legalMoves.end(), std::back_inserter(untried), [&](auto const &m){
-            return std::none_of(m_children.begin(), m_children.end(), [&](auto const &c){ return c->m_move == m; });
-        });
+        untriedMoves(legalMoves, untried);
         return untried;
     }
 
+    // Replace the contents of untried by the legal moves without a child
+    void untriedMoves(std::vector<Move> const &legalMoves, std::vector<Move> &untried) const
+    {
+        auto &tried = threadBuffer<char>();
+        tried.assign(legalMoves.size(), false);
+        forEachLegalChild(legalMoves, [&](std::size_t i, Node *){ tried[i] = true; });
+        untried.clear();
+        for (std::size_t i = 0; i < legalMoves.size(); ++i) {
+            if (!tried[i])
+                untried.emplace_back(legalMoves[i]);
+        }
+    }
+
+    bool hasUntriedMoves(std::vector<Move> const &legalMoves) const
+    {
+        std::size_t tried {0};
+        forEachLegalChild(legalMoves, [&](std::size_t, Node *){ ++tried; });
+        return tried < legalMoves.size();
+    }
+
+    // The number of bytes used by this node, including any memory it allocated
+    // itself; overridden by each node type with additional data
+    virtual std::size_t memoryUsage() const
+    {
+        return sizeof(Node) + m_children.memoryUsage();
+    }
+
+    // The number of bytes used by this node and its descendants
+    std::size_t treeMemoryUsage() const
+    {
+        return std::accumulate(m_children.begin(), m_children.end(), memoryUsage(), [](std::size_t sum, auto const &c){
+            return sum + c->treeMemoryUsage();
+        });
+    }
+
     virtual operator std::string() const { return ""; }
 
     std::string treeToString(unsigned int indent = 0) const
@@ -106,27 +220,82 @@ public:
     }
 
 protected:
-    using Lock = std::lock_guard<std::mutex>;
-    std::mutex &mutex() const { return m_mutex; }
+    using Lock = std::lock_guard<SpinLock>;
+    SpinLock &mutex() const { return m_mutex; }
 
 private:
+    // Ordered to avoid padding for small move types
     Node *m_parent = nullptr;
-    std::mutex mutable m_mutex;
-    std::vector<ChildPtr> m_children;
+    NodeArena *m_arena {nullptr};
+    ChildList m_children;
     Move const m_move;
     unsigned int const m_playerJustMoved;
     std::atomic_uint m_visits {0};
+    std::atomic_uint m_virtualLoss {0};
+    SpinLock mutable m_mutex;
 
     // m_mutex assumed locked
     Node *addChildLocked(ChildPtr child)
     {
         child->m_parent = this;
-        m_children.emplace_back(std::move(child));
-        return m_children.back().get();
+        return m_children.push_back(std::move(child), m_arena).get();
+    }
+
+    // Below this number of children and legal moves, matching them by linear
+    // search is faster than sorting the legal moves first
+    std::size_t static constexpr s_sortThreshold {16};
+
+    // Call f(i, child) for each child whose move is legalMoves[i]
+    template<class F>
+    void forEachLegalChild(std::vector<Move> const &legalMoves, F &&f) const
+    {
+        if (legalMoves.size() < s_sortThreshold || m_children.size() < s_sortThreshold)
+            forEachLegalChild(legalMoves, f, std::false_type{});
+        else
+            forEachLegalChild(legalMoves, f, IsOrdered<Move>{});
+    }
+
+    template<class F>
+    void forEachLegalChild(std::vector<Move> const &legalMoves, F &f, std::false_type) const
+    {
+        for (auto &c : m_children) {
+            auto const pos = std::find(legalMoves.begin(), legalMoves.end(), c->m_move);
+            if (pos != legalMoves.end())
+                f(pos - legalMoves.begin(), c.get());
+        }
+    }
+
+    // Look up each child in an index of the legal moves sorted by move, which
+    // takes O((children + moves) log moves) instead of O(children * moves)
+    template<class F>
+    void forEachLegalChild(std::vector<Move> const &legalMoves, F &f, std::true_type) const
+    {
+        auto &index = threadBuffer<std::size_t>();
+        index.resize(legalMoves.size());
+        std::iota(index.begin(), index.end(), 0);
+        std::sort(index.begin(), index.end(), [&](std::size_t a, std::size_t b){ return legalMoves[a] < legalMoves[b]; });
+        for (auto &c : m_children) {
+            auto const pos = std::lower_bound(index.begin(), index.end(), c->m_move, [&](std::size_t i, Move const &move){
+                return legalMoves[i] < move;
+            });
+            if (pos != index.end() && legalMoves[*pos] == c->m_move)
+                f(*pos, c.get());
+        }
+    }
+
+    Node *findChild(Move const &move, typename ChildList::const_iterator first, std::size_t count) const
+    {
+        for (; count > 0; --count, ++first) {
+            if ((*first)->m_move == move)
+                return first->get();
+        }
+        return nullptr;
     }
 
     virtual void updateData(Game<Move> const &terminalState) = 0;
 
+    virtual void addResults(unsigned int /*count*/, double /*totalResult*/) {}
+
     std::string indentSelf(unsigned int indent) const
     {
         std::string s;
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2019 Steven Franzen <sfranzen85@gmail.com>
+ * This file is subject to the terms of the MIT License; see the LICENSE file in
+ * the root directory of this distribution.
+ */
+#ifndef ISMCTS_SPINLOCK_H
+#define ISMCTS_SPINLOCK_H
+
+#include <atomic>
+#include <thread>
+
+namespace ISMCTS
+{
+
+/*
+ * Mutex occupying a single byte, for guarding the short critical sections of
+ * tree nodes. A waiting thread yields instead of blocking, so it should not be
+ * held for long.
+ */
+class SpinLock
+{
+public:
+    SpinLock() = default;
+    SpinLock(SpinLock const &) = delete;
+    SpinLock &operator=(SpinLock const &) = delete;
+
+    void lock()
+    {
+        while (m_flag.test_and_set(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+
+    bool try_lock()
+    {
+        return !m_flag.test_and_set(std::memory_order_acquire);
+    }
+
+    void unlock()
+    {
+        m_flag.clear(std::memory_order_release);
+    }
+
+private:
+    std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+};
+
+} // ISMCTS
+
+#endif // ISMCTS_SPINLOCK_H
@@ -11,7 +11,6 @@
 
 #include <algorithm>
 #include <cmath>
-#include <mutex>
 #include <tuple>
 #include <vector>
 
@@ -19,6 +18,13 @@ namespace ISMCTS
 {
 
 // Sliding Window UCB
+//
+// The node keeps its results in a ring buffer, along with their count and sum;
+// results leaving the window are dropped from the front when the sums are
+// requested. The buffer grows as results are added, but never beyond the
+// window size, after which the oldest result is overwritten. The window is set
+// either by the policy when the node is created or by the first call to
+// rewardSums; until then, the buffer is not bounded.
 template<class Move>
 class SW_UCBNode : public UCBNode<Move>
 {
@@ -26,32 +32,99 @@ public:
     using UCBNode<Move>::UCBNode;
     using ResultType = std::tuple<unsigned, double>;
 
+    void setWindow(unsigned window)
+    {
+        Lock lock {this->mutex()};
+        bind(window);
+    }
+
+    // The window argument only takes effect if the window was not yet set
     ResultType rewardSums(unsigned window) const
     {
-        unsigned N {0};
-        double X {0};
-        auto const min = window > this->available() ? 0 : this->available() - window + 1;
+        Lock lock {this->mutex()};
+        if (m_window == 0)
+            bind(window);
+        auto const min = m_window > this->available() ? 0 : this->available() - m_window + 1;
+        while (m_count > 0 && m_results[m_first].trial < min)
+            popFront();
+        return std::make_tuple(m_count, m_sum);
+    }
 
+    std::size_t memoryUsage() const override
+    {
         Lock lock {this->mutex()};
-        auto s = std::find_if(m_trials.begin(), m_trials.end(), [=](unsigned t){ return t >= min; });
-        for (auto r = m_results.begin() + (s - m_trials.begin()); r != m_results.end(); ++s, ++r) {
-            N += *s;
-            X += *r;
-        }
-        return std::make_tuple(N, X);
+        return UCBNode<Move>::memoryUsage() + sizeof(SW_UCBNode) - sizeof(UCBNode<Move>)
+            + m_results.capacity() * sizeof(Result);
     }
 
+    // The window holds each result separately
+    bool canBatchUpdates() const override { return false; }
+
 private:
     using typename UCBNode<Move>::Lock;
 
-    std::vector<double> m_results;
-    std::vector<unsigned> m_trials;
+    struct Result
+    {
+        double value;
+        unsigned trial;
+    };
+
+    std::vector<Result> mutable m_results;
+    std::size_t mutable m_first {0};
+    unsigned mutable m_count {0};
+    unsigned mutable m_window {0};
+    double mutable m_sum {0};
 
     void updateData(Game<Move> const &terminalState) override
     {
         Lock lock {this->mutex()};
-        m_trials.emplace_back(this->available());
-        m_results.emplace_back(terminalState.getResult(this->player()));
+        Result const result {terminalState.getResult(this->player()), this->available()};
+        if (m_window > 0 && m_count == m_window)
+            popFront();
+        if (m_count == m_results.size())
+            grow(result);
+        else
+            m_results[(m_first + m_count) % m_results.size()] = result;
+        ++m_count;
+        m_sum += result.value;
+    }
+
+    // Mutex assumed locked
+    void bind(unsigned window) const
+    {
+        m_window = std::max(window, 1u);
+        while (m_count > m_window)
+            popFront();
+        if (m_results.capacity() > m_window) {
+            unwrap();
+            m_results.resize(m_count);
+            m_results.shrink_to_fit();
+        }
+    }
+
+    // Append a result to a full buffer, allocating at most the window size
+    void grow(Result const &result) const
+    {
+        unwrap();
+        if (m_window > 0 && m_results.size() == m_results.capacity())
+            m_results.reserve(std::min<std::size_t>(std::max<std::size_t>(2 * m_results.size(), 4), m_window));
+        m_results.emplace_back(result);
+    }
+
+    // Move the oldest result to the front of the buffer
+    void unwrap() const
+    {
+        std::rotate(m_results.begin(), m_results.begin() + m_first, m_results.end());
+        m_first = 0;
+    }
+
+    void popFront() const
+    {
+        m_sum -= m_results[m_first].value;
+        m_first = (m_first + 1) % m_results.size();
+        // Avoid accumulating rounding errors
+        if (--m_count == 0)
+            m_sum = 0;
     }
 };
 
@@ -66,6 +139,12 @@ public:
         , m_window{window}
     {}
 
+    // Called by the solvers for each new node
+    void initialise(Node &node) const
+    {
+        node.setWindow(m_window);
+    }
+
     Node *operator()(std::vector<Node*> const &nodes) const
     {
         using Result = typename Node::ResultType;
@@ -74,7 +153,11 @@ public:
             node->markAvailable();
 
         std::vector<Result> results(nodes.size());
-        std::transform(nodes.begin(), nodes.end(), results.begin(), [=](Node const *node){ return node->rewardSums(m_window); });
+        std::transform(nodes.begin(), nodes.end(), results.begin(), [=](Node const *node){
+            auto sums = node->rewardSums(m_window);
+            std::get<0>(sums) += node->virtualLoss();
+            return sums;
+        });
 
         auto const n = std::min(m_window, sum(results, [](Result const &r){ return std::get<0>(r); }));
         std::vector<double> ucbScores(nodes.size());
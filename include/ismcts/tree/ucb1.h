@@ -16,6 +16,7 @@
 #include <iomanip>
 #include <string>
 #include <sstream>
+#include <vector>
 
 namespace ISMCTS
 {
@@ -28,32 +29,52 @@ public:
 
     unsigned int available() const { return m_available; }
 
-    void markAvailable()
+    // Returns the new count
+    unsigned int markAvailable()
     {
-        ++m_available;
+        return ++m_available;
     }
 
     double ucbScore(double exploration) const
     {
-        return ucb(m_score / this->visits(), exploration, m_available, this->visits());
+        return ucbScore(exploration, m_available);
     }
 
+    // Virtual losses count as visits without reward
+    double ucbScore(double exploration, unsigned int available) const
+    {
+        double const visits = this->visits() + this->virtualLoss();
+        return ucbFromTable(m_score / visits, exploration, available, visits);
+    }
+
+    std::size_t memoryUsage() const override
+    {
+        return Node<Move>::memoryUsage() + sizeof(UCBNode) - sizeof(Node<Move>);
+    }
+
+    bool canBatchUpdates() const override { return true; }
+
     operator std::string() const override
     {
         std::ostringstream oss;
         oss << "[M:" << this->move() << " by " << this->player() << ", V/S/A: ";
-        oss << std::fixed << std::setprecision(1) << this->visits() << "/" << m_score << "/" << m_available << "]";
+        oss << std::fixed << std::setprecision(1) << this->visits() << "/" << double(m_score) << "/" << m_available << "]";
         return oss.str();
     }
 
 private:
-    std::atomic<double> m_score {0};
+    AtomicFixedPoint<> m_score {0};
     std::atomic_uint m_available {1};
 
     void updateData(Game<Move> const &terminalState) override
     {
         m_score += terminalState.getResult(this->player());
     }
+
+    void addResults(unsigned int, double totalResult) override
+    {
+        m_score += totalResult;
+    }
 };
 
 template<class Move>
@@ -66,13 +87,15 @@ public:
         : m_exploration{std::max(0., exploration)}
     {}
 
+    // Each score is computed once into a buffer
     Node *operator()(std::vector<Node*> const &nodes) const
     {
-        for (auto &node : nodes)
-            node->markAvailable();
-        return *std::max_element(nodes.begin(), nodes.end(), [&](Node const *a, Node const *b){
-            return a->ucbScore(m_exploration) < b->ucbScore(m_exploration);
+        auto &scores = threadBuffer<double>();
+        scores.resize(nodes.size());
+        std::transform(nodes.begin(), nodes.end(), scores.begin(), [=](Node *node){
+            return node->ucbScore(m_exploration, node->markAvailable());
         });
+        return nodes[std::max_element(scores.begin(), scores.end()) - scores.begin()];
     }
 
     double explorationConstant() const { return m_exploration; }
@@ -6,12 +6,14 @@
 #ifndef ISMCTS_UTILITY_H
 #define ISMCTS_UTILITY_H
 
+#include <array>
 #include <atomic>
 #include <cmath>
 #include <chrono>
 #include <cstdint>
 #include <numeric>
 #include <random>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -40,37 +42,180 @@ double inline operator+=(std::atomic<double> &d, double other)
     return newValue;
 }
 
+// Atomic sum of real numbers in fixed-point representation, with a resolution
+// of 2^-FractionBits. Unlike atomic<double>, additions are a single fetch_add
+// that never needs to be retried when threads contend for the value.
+template<unsigned int FractionBits = 24>
+class AtomicFixedPoint
+{
+public:
+    AtomicFixedPoint(double value = 0)
+        : m_value{toFixed(value)}
+    {}
+
+    AtomicFixedPoint(AtomicFixedPoint const &) = delete;
+    AtomicFixedPoint &operator=(AtomicFixedPoint const &) = delete;
+
+    operator double() const
+    {
+        return m_value.load(std::memory_order_relaxed) / s_scale;
+    }
+
+    AtomicFixedPoint &operator+=(double value)
+    {
+        m_value.fetch_add(toFixed(value), std::memory_order_relaxed);
+        return *this;
+    }
+
+private:
+    double static constexpr s_scale = std::int64_t{1} << FractionBits;
+    std::atomic<std::int64_t> m_value;
+
+    std::int64_t static toFixed(double value)
+    {
+        return std::llround(value * s_scale);
+    }
+};
+
+// Call f repeatedly until the deadline has passed or stop is set, but at least
+// once, so that a worker starting late still contributes a result. The clock
+// and flag are only read after batches of calls, sized from the measured time
+// per call so that they are checked about every checkInterval and the deadline
+// is not overshot by more than one call.
 template<class Callable, class... Args>
-void executeFor(std::atomic_size_t &count, std::size_t chunk, Callable&& f, Args&&... args)
+void executeUntil(std::chrono::steady_clock::time_point deadline, std::atomic_bool const &stop,
+                  Callable&& f, Args&&... args)
 {
-    while (count > 0)
-        for (auto i = decrement(count, chunk); i > 0; --i)
+    using clock = std::chrono::steady_clock;
+    using Duration = std::chrono::duration<double>;
+    Duration constexpr checkInterval {1e-4};
+    double batch {1};
+    auto now = clock::now();
+    do {
+        auto const start = now;
+        for (auto i = std::size_t(batch); i > 0; --i)
             f(std::forward<Args>(args)...);
+        now = clock::now();
+        auto const perCall = Duration{now - start} / std::size_t(batch);
+        auto const target = std::min(checkInterval, Duration{deadline - now});
+        if (perCall.count() > 0)
+            batch = std::max(1., std::min(2 * batch, target / perCall));
+        else
+            batch *= 2;
+    } while (now < deadline && !stop.load(std::memory_order_relaxed));
 }
 
 template<class Callable, class... Args>
 void executeFor(std::chrono::duration<double> time, Callable&& f, Args&&... args)
 {
-    using clock = std::chrono::high_resolution_clock;
-    while (time.count() > 0) {
-        auto const start = clock::now();
-        f(std::forward<Args>(args)...);
-        time -= clock::now() - start;
-    }
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(time);
+    std::atomic_bool const never {false};
+    executeUntil(deadline, never, std::forward<Callable>(f), std::forward<Args>(args)...);
 }
 
-template<class RNG = std::mt19937>
+// Advance the SplitMix64 state x and return its next output
+std::uint64_t inline splitMix64(std::uint64_t &x)
+{
+    auto z = (x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// Derive a seed for one of the random number streams of a search, so that
+// each combination of master seed, search and worker gets its own stream
+std::uint64_t inline streamSeed(std::uint64_t seed, std::uint64_t search, std::uint64_t worker)
+{
+    auto x = splitMix64(seed) ^ search;
+    x = splitMix64(x) ^ worker;
+    return splitMix64(x);
+}
+
+/*
+ * The xoshiro256** generator by Blackman and Vigna: a fast generator of 64 bit
+ * numbers with only 32 bytes of state, suitable for everything except
+ * cryptography. Seeds are expanded into the state using SplitMix64.
+ */
+class Xoshiro256
+{
+public:
+    using result_type = std::uint64_t;
+
+    explicit Xoshiro256(result_type seed = 0)
+    {
+        this->seed(seed);
+    }
+
+    void seed(result_type seed)
+    {
+        for (auto &s : m_state)
+            s = splitMix64(seed);
+    }
+
+    result_type static constexpr min() { return 0; }
+    result_type static constexpr max() { return ~result_type{0}; }
+
+    result_type operator()()
+    {
+        auto const result = rotl(m_state[1] * 5, 7) * 9;
+        auto const t = m_state[1] << 17;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+        return result;
+    }
+
+private:
+    std::array<result_type, 4> m_state;
+
+    result_type static rotl(result_type x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+// The generator used by default for all random choices made by the library
+using DefaultRNG = Xoshiro256;
+
+// A randomly seeded generator of the given type, one for each thread. Solvers
+// with a fixed seed reseed the default generator of their worker threads.
+template<class RNG = DefaultRNG>
 RNG &prng()
 {
-    std::mt19937 thread_local static prng {std::random_device{}()};
+    RNG thread_local static prng {static_cast<typename RNG::result_type>(std::random_device{}())};
     return prng;
 }
 
-template<class T>
+// Uniformly distributed integer in [0, n), for n > 0. For generators of 64 bit
+// numbers and n < 2^32 this uses Lemire's multiply-and-shift method, which
+// rarely needs a division; otherwise it falls back to the standard library.
+template<class RNG>
+std::size_t randomIndex(std::size_t n, RNG &rng)
+{
+    if (RNG::min() != 0 || RNG::max() != ~std::uint64_t{0} || n > 0xffffffff) {
+        std::uniform_int_distribution<std::size_t> dist {0, n - 1};
+        return dist(rng);
+    }
+    auto const range = static_cast<std::uint32_t>(n);
+    auto m = (rng() >> 32) * range;
+    auto low = static_cast<std::uint32_t>(m);
+    if (low < range) {
+        auto const threshold = static_cast<std::uint32_t>(-range) % range;
+        while (low < threshold) {
+            m = (rng() >> 32) * range;
+            low = static_cast<std::uint32_t>(m);
+        }
+    }
+    return static_cast<std::size_t>(m >> 32);
+}
+
+template<class RNG = DefaultRNG, class T>
 T const &randomElement(std::vector<T> const &v)
 {
-    std::uniform_int_distribution<std::size_t> randIdx {0, v.size() - 1};
-    return v[randIdx(prng())];
+    return v[randomIndex(v.size(), prng<RNG>())];
 }
 
 template<class T>
@@ -82,6 +227,23 @@ struct RandomElement
     }
 };
 
+// Whether values of type T can be compared using operator<
+template<class T, class = void>
+struct IsOrdered : std::false_type {};
+
+template<class T>
+struct IsOrdered<T, decltype(void(std::declval<T const &>() < std::declval<T const &>()))> : std::true_type {};
+
+// A vector of T kept by each thread, for functions that need temporary storage
+// on every call but should not allocate it each time. Callers using the same
+// type share the vector, so its contents are only valid until the next one.
+template<class T>
+std::vector<T> &threadBuffer()
+{
+    std::vector<T> thread_local static buffer;
+    return buffer;
+}
+
 // Sum the results of operator op applied to each element of container c.
 template<class C, class Op>
 auto sum(C const &c, Op op)
@@ -93,11 +255,30 @@ auto sum(C const &c, Op op)
     });
 }
 
+// Natural logarithm of an unsigned integer, looked up in a table for small n
+double inline logarithm(unsigned int n)
+{
+    static auto const table = []{
+        std::array<double, 4096> table;
+        for (std::size_t i = 0; i < table.size(); ++i)
+            table[i] = std::log(i);
+        return table;
+    }();
+    return n < table.size() ? table[n] : std::log(n);
+}
+
 double inline ucb(double X, double C, double n, double N)
 {
     return X + C * std::sqrt(std::log(n) / N);
 }
 
+// As ucb(), for an integer trial count n whose logarithm is looked up in the
+// table of logarithm()
+double inline ucbFromTable(double X, double C, unsigned int n, double N)
+{
+    return X + C * std::sqrt(logarithm(n) / N);
+}
+
 } // ISMCTS
 
 #endif // ISMCTS_UTILITY_H
@@ -15,6 +15,7 @@
 
 #include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <iomanip>
 #include <sstream>
 #include <string>
@@ -29,6 +30,16 @@ using namespace ISMCTS;
 unsigned int constexpr numGames {100};
 unsigned int constexpr iterationCount {1000};
 
+// Fixed seed for the games and solvers, so that runs can be compared
+std::uint64_t constexpr seed {2019};
+
+template<class Solver>
+Solver &&seeded(Solver &&solver)
+{
+    solver.setSeed(seed);
+    return std::forward<Solver>(solver);
+}
+
 // Test one "move generator" against another in a given game
 class SolverTester
 {
@@ -134,11 +145,11 @@ void testAllPolicies(Game &&game, unsigned games)
     auto &&gameRef = std::forward<Game>(game);
 
     SECTION("Sequential")
-        singleTest(tester, gameRef, Solver<Move, Sequential>{iterationCount}, Opponent<Move>{}...);
+        singleTest(tester, gameRef, seeded(Solver<Move, Sequential>{iterationCount}), Opponent<Move>{}...);
     SECTION("RootParallel")
-        singleTest(tester, gameRef, Solver<Move, RootParallel>{iterationCount}, Opponent<Move>{}...);
+        singleTest(tester, gameRef, seeded(Solver<Move, RootParallel>{iterationCount}), Opponent<Move>{}...);
     SECTION("TreeParallel")
-        singleTest(tester, gameRef, Solver<Move, TreeParallel>{iterationCount}, Opponent<Move>{}...);
+        singleTest(tester, gameRef, seeded(Solver<Move, TreeParallel>{iterationCount}), Opponent<Move>{}...);
 }
 
 template<SOLVER_SIG class Solver>
@@ -163,6 +174,7 @@ void vsSelf(unsigned games)
 
 TEST_CASE("Versus random player", "[SOSolver][MOSolver]")
 {
+    prng().seed(seed);
     SECTION("SOSolver")
         vsRandom<SOSolver>(numGames);
     SECTION("MOSolver")
@@ -171,6 +183,7 @@ TEST_CASE("Versus random player", "[SOSolver][MOSolver]")
 
 TEST_CASE("Versus self", "[SOSolver][MOSolver]")
 {
+    prng().seed(seed);
     SECTION("SOSolver")
         vsSelf<SOSolver>(numGames);
     SECTION("MOSolver")
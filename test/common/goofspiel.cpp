@@ -11,6 +11,7 @@
 #include <map>
 #include <memory>
 #include <random>
+#include <typeinfo>
 
 namespace {
 
@@ -55,26 +56,38 @@ Goofspiel::Goofspiel()
 
 void Goofspiel::shufflePrizes()
 {
-    std::mt19937 static thread_local prng {std::random_device{}()};
-    std::shuffle(m_prizes.begin(), m_prizes.end(), prng);
+    std::shuffle(m_prizes.begin(), m_prizes.end(), ISMCTS::prng());
 }
 
 Goofspiel::Clone Goofspiel::cloneAndRandomise(Player observer) const
 {
     auto clone = std::make_unique<Goofspiel>(*this);
+    clone->randomise(observer);
+    return clone;
+}
+
+bool Goofspiel::randomiseInto(Game &target, Player observer) const
+{
+    if (typeid(target) != typeid(*this))
+        return false;
+    auto &game = static_cast<Goofspiel&>(target);
+    game = *this;
+    game.randomise(observer);
+    return true;
+}
 
+void Goofspiel::randomise(Player observer)
+{
     // The order of the remaining prizes is unknown to both players
     if (observer != 2)
-        clone->shufflePrizes();
+        shufflePrizes();
 
     // The solver always calls this function with observer == m_player and
     // player 0 always goes first, so the only other bit of hidden information
     // can be player 0's current move from player 1's point of view
     assert(observer == m_player);
     if (observer == 1)
-        clone->m_moves[0] = ISMCTS::randomElement(clone->m_hands[0]);
-
-    return clone;
+        m_moves[0] = ISMCTS::randomElement(m_hands[0]);
 }
 
 bool Goofspiel::currentMoveSimultaneous() const
@@ -137,18 +150,26 @@ std::vector<Goofspiel::Player> Goofspiel::players() const
 
 std::vector<Card> Goofspiel::validMoves() const
 {
-    if (m_player != 2)
-        return m_hands[m_player];
-    else if (!m_drawPrize)
-        // Return a constant dummy vector because the next turn is only used to
+    std::vector<Card> moves;
+    fillValidMoves(moves);
+    return moves;
+}
+
+void Goofspiel::fillValidMoves(std::vector<Card> &moves) const
+{
+    if (m_player != 2) {
+        moves.assign(m_hands[m_player].begin(), m_hands[m_player].end());
+    } else if (!m_drawPrize) {
+        // Return a constant dummy move because the next turn is only used to
         // "reveal" the bids and award points; it should not lead to different
         // paths in the game tree
-        return {Card{}};
-    else if (!m_prizes.empty())
-        return {m_prizes.back()};
-
-    assert(m_prizes.empty());
-    assert(m_hands[0].empty());
-    assert(m_hands[1].empty());
-    return {};
+        moves.assign(1, Card{});
+    } else if (!m_prizes.empty()) {
+        moves.assign(1, m_prizes.back());
+    } else {
+        assert(m_prizes.empty());
+        assert(m_hands[0].empty());
+        assert(m_hands[1].empty());
+        moves.clear();
+    }
 }
@@ -21,17 +21,19 @@
  * choosing a rank from their hand (Ace to K). The value of the current prize
  * card goes to the winning bid or to neither player if the bids are tied.
  */
-class Goofspiel : public ISMCTS::POMGame<Card>
+class Goofspiel final : public ISMCTS::POMGame<Card>
 {
 public:
     explicit Goofspiel();
 
     Clone cloneAndRandomise(Player observer) const override;
+    bool randomiseInto(Game &target, Player observer) const override;
     Player currentPlayer() const override;
     void doMove(Card const move) override;
     double getResult(Player player) const override;
     std::vector<Player> players() const override;
     std::vector<Card> validMoves() const override;
+    void fillValidMoves(std::vector<Card> &moves) const override;
     bool currentMoveSimultaneous() const override;
 
 private:
@@ -45,6 +47,7 @@ private:
     Player m_player {2};
     bool m_drawPrize {true};
 
+    void randomise(Player observer);
     void shufflePrizes();
     void handleP2Turn(Card const &move);
 };
@@ -4,6 +4,7 @@
  * the root directory of this distribution.
  */
 #include "knockoutwhist.h"
+#include <ismcts/utility.h>
 
 #include <algorithm>
 #include <memory>
@@ -13,6 +14,7 @@
 #include <random>
 #include <stdexcept>
 #include <string>
+#include <typeinfo>
 
 namespace
 {
@@ -25,12 +27,6 @@ inline std::vector<Card> trumpChoices()
     return cards;
 }
 
-inline std::mt19937 &prng()
-{
-    std::mt19937 static thread_local prng;
-    return prng;
-}
-
 }
 
 KnockoutWhist::KnockoutWhist(unsigned players)
@@ -56,6 +52,23 @@ KnockoutWhist::KnockoutWhist(unsigned players)
 KnockoutWhist::Clone KnockoutWhist::cloneAndRandomise(Player observer) const
 {
     auto clone = std::make_unique<KnockoutWhist>(*this);
+    clone->randomise(observer);
+    return clone;
+}
+
+bool KnockoutWhist::randomiseInto(Game &target, Player observer) const
+{
+    if (typeid(target) != typeid(*this))
+        return false;
+    auto &game = static_cast<KnockoutWhist&>(target);
+    game = *this;
+    game.randomise(observer);
+    return true;
+}
+
+// Redistribute the cards the observer has not seen among the other players
+void KnockoutWhist::randomise(Player observer)
+{
     Hand unseenCards = m_unknownCards;
     for (auto p : m_players) {
         if (p == observer)
@@ -63,16 +76,15 @@ KnockoutWhist::Clone KnockoutWhist::cloneAndRandomise(Player observer) const
         auto const &hand = m_playerCards[p];
         unseenCards.insert(unseenCards.end(), hand.begin(), hand.end());
     }
-    std::shuffle(unseenCards.begin(), unseenCards.end(), prng());
+    std::shuffle(unseenCards.begin(), unseenCards.end(), ISMCTS::prng());
     auto u = unseenCards.begin();
     for (auto p : m_players) {
         if (p == observer)
             continue;
-        auto &hand = clone->m_playerCards[p];
+        auto &hand = m_playerCards[p];
         std::copy_n(u, hand.size(), hand.begin());
         u += hand.size();
     }
-    return clone;
 }
 
 KnockoutWhist::Player KnockoutWhist::currentPlayer() const
@@ -120,24 +132,33 @@ double KnockoutWhist::getResult(Player player) const
 }
 
 std::vector<Card> KnockoutWhist::validMoves() const
+{
+    std::vector<Card> moves;
+    fillValidMoves(moves);
+    return moves;
+}
+
+void KnockoutWhist::fillValidMoves(std::vector<Card> &moves) const
 {
     // Allow first player to bid on rounds other than the first
-    if (m_requestTrump)
-        return trumpChoices();
+    if (m_requestTrump) {
+        moves = trumpChoices();
+        return;
+    }
 
     auto const &hand = m_playerCards[m_player];
-    if (m_currentTrick.empty() || hand.size() < 2)
-        return hand;
-
-    auto const leadCard = m_currentTrick.front().second;
-    Hand cardsInSuit;
-    std::copy_if(hand.begin(), hand.end(), std::back_inserter(cardsInSuit), [&](auto const &c){ return c.suit == leadCard.suit; });
-    return cardsInSuit.empty() ? hand : cardsInSuit;
+    moves.clear();
+    if (!m_currentTrick.empty() && hand.size() > 1) {
+        auto const leadCard = m_currentTrick.front().second;
+        std::copy_if(hand.begin(), hand.end(), std::back_inserter(moves), [&](auto const &c){ return c.suit == leadCard.suit; });
+    }
+    if (moves.empty())
+        moves.assign(hand.begin(), hand.end());
 }
 
 void KnockoutWhist::deal()
 {
-    std::shuffle(m_deck.begin(), m_deck.end(), prng());
+    std::shuffle(m_deck.begin(), m_deck.end(), ISMCTS::prng());
 
     auto pos = m_deck.begin();
     for (auto p : m_players) {
@@ -206,7 +227,7 @@ KnockoutWhist::Player KnockoutWhist::roundWinner() const
         return m_tricksTaken[p] == maxTricksTaken;
     });
     std::uniform_int_distribution<std::size_t> randPlayer {0, playersTied - 1};
-    return players[randPlayer(prng())];
+    return players[randPlayer(ISMCTS::prng())];
 }
 
 std::ostream& operator<<(std::ostream &out, KnockoutWhist const &g)
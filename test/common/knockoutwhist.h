@@ -22,9 +22,11 @@ class KnockoutWhist : public ISMCTS::POMGame<Card>
 public:
     explicit KnockoutWhist(unsigned players = 4);
     virtual Clone cloneAndRandomise(Player observer) const override;
+    virtual bool randomiseInto(Game &target, Player observer) const override;
     virtual Player currentPlayer() const override;
     virtual std::vector<Player> players() const override;
     virtual std::vector<Card> validMoves() const override;
+    virtual void fillValidMoves(std::vector<Card> &moves) const override;
     virtual void doMove(Card const move) override;
     virtual double getResult(Player player) const override;
     friend std::ostream &operator<<(std::ostream &out, KnockoutWhist const &g);
@@ -47,6 +49,7 @@ protected:
     Card::Suit m_trumpSuit;
     bool m_requestTrump = false;
 
+    void randomise(Player observer);
     Player nextPlayer(Player p) const;
     void deal();
     void finishTrick();
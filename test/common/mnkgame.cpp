@@ -12,6 +12,7 @@
 #include <array>
 #include <ostream>
 #include <iomanip>
+#include <typeinfo>
 
 namespace
 {
@@ -36,6 +37,14 @@ MnkGame::Clone MnkGame::cloneAndRandomise(unsigned) const
     return std::make_unique<MnkGame>(*this);
 }
 
+bool MnkGame::randomiseInto(Game &target, unsigned) const
+{
+    if (typeid(target) != typeid(*this))
+        return false;
+    static_cast<MnkGame&>(target) = *this;
+    return true;
+}
+
 void MnkGame::doMove(const int move)
 {
     auto const loc = std::find(m_moves.begin(), m_moves.end(), move);
@@ -63,6 +72,14 @@ std::vector<int> MnkGame::validMoves() const
     return m_result == -1 ? m_moves : std::vector<int>{};
 }
 
+void MnkGame::fillValidMoves(std::vector<int> &moves) const
+{
+    if (m_result == -1)
+        moves.assign(m_moves.begin(), m_moves.end());
+    else
+        moves.clear();
+}
+
 MnkGame::Player MnkGame::currentPlayer() const
 {
     return m_player;
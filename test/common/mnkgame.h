@@ -22,9 +22,11 @@ class MnkGame : public ISMCTS::POMGame<int>
 public:
     explicit MnkGame(int m = 3, int n = 3, int k = 3);
     virtual Clone cloneAndRandomise(Player observer) const override;
+    virtual bool randomiseInto(Game &target, Player observer) const override;
     virtual Player currentPlayer() const override;
     virtual std::vector<Player> players() const override;
     virtual std::vector<int> validMoves() const override;
+    virtual void fillValidMoves(std::vector<int> &moves) const override;
     virtual void doMove(int const move) override;
     virtual double getResult(Player player) const override;
     friend std::ostream &operator<<(std::ostream &out, MnkGame const &g);
@@ -4,10 +4,14 @@
  * the root directory of this distribution.
  */
 #include "phantommnkgame.h"
+#include <ismcts/utility.h>
+
 #include <algorithm>
 #include <memory>
 #include <numeric>
 #include <random>
+#include <stdexcept>
+#include <typeinfo>
 
 PhantomMnkGame::PhantomMnkGame(int m, int n, int k)
     : MnkGame{m, n, k}
@@ -30,12 +34,27 @@ PhantomMnkGame::PhantomMnkGame(int m, int n, int k)
 PhantomMnkGame::Clone PhantomMnkGame::cloneAndRandomise(Player observer) const
 {
     auto clone = std::make_unique<PhantomMnkGame>(*this);
-    auto const opponent = 1 - observer;
-    auto const numMoves = clone->undoMoves(opponent);
-    clone->randomReplay(opponent, numMoves);
+    clone->randomise(observer);
     return clone;
 }
 
+bool PhantomMnkGame::randomiseInto(Game &target, Player observer) const
+{
+    if (typeid(target) != typeid(*this))
+        return false;
+    auto &game = static_cast<PhantomMnkGame&>(target);
+    game = *this;
+    game.randomise(observer);
+    return true;
+}
+
+void PhantomMnkGame::randomise(Player observer)
+{
+    auto const opponent = 1 - observer;
+    auto const numMoves = undoMoves(opponent);
+    randomReplay(opponent, numMoves);
+}
+
 // Only undo those moves that are still marked as available in the opponent's
 // view of the game state
 unsigned PhantomMnkGame::undoMoves(Player player)
@@ -59,10 +78,9 @@ unsigned PhantomMnkGame::undoMoves(Player player)
 
 void PhantomMnkGame::randomReplay(Player player, unsigned numMoves)
 {
-    std::mt19937 static thread_local prng {std::random_device{}()};
     auto newState = *this;
     auto moves = m_moves;
-    std::shuffle(moves.begin(), moves.end(), prng);
+    std::shuffle(moves.begin(), moves.end(), ISMCTS::prng());
     moves.resize(numMoves);
 
     // Ensure a non-winning state
@@ -109,3 +127,8 @@ std::vector<int> PhantomMnkGame::validMoves() const
 {
     return m_available[m_player];
 }
+
+void PhantomMnkGame::fillValidMoves(std::vector<int> &moves) const
+{
+    moves.assign(m_available[m_player].begin(), m_available[m_player].end());
+}
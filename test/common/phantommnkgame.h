@@ -22,12 +22,16 @@ class PhantomMnkGame : public MnkGame
 public:
     explicit PhantomMnkGame(int m = 3, int n = 3, int k = 3);
     Clone cloneAndRandomise(Player observer) const override;
+    bool randomiseInto(Game &target, Player observer) const override;
     void doMove(int const move) override;
     std::vector<int> validMoves() const override;
+    void fillValidMoves(std::vector<int> &moves) const override;
 
 protected:
     std::array<std::vector<int>, 2> m_available;
 
+    // Randomise the moves unknown to the observer
+    void randomise(Player observer);
     // Undo moves for the given player and return the number of moves
     unsigned undoMoves(Player player);
     // Try applying the given number of randomly selected moves for the given
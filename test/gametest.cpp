@@ -125,6 +125,8 @@ TEST_CASE("KnockoutWhist::doMove works", "[KnockoutWhist]")
     // Note: invalid means any card not held by the player as the game does not
     // check for failures to follow suit
     SECTION("Invalid move gives exception") {
+        // The deal is random, so use the fixed one to know which card is absent
+        MockWhist game;
         Card const invalidMove {Card::Seven, Card::Diamonds};
         REQUIRE_THROWS_AS(game.doMove(invalidMove), std::out_of_range);
     }
@@ -277,3 +279,81 @@ TEST_CASE("PhantomMnkGame::cloneAndRandomise does not modify known positions", "
     REQUIRE(rClone.board()[1][1] == 0);
     REQUIRE(rClone.board()[2][0] == 0);
 }
+
+TEST_CASE("PhantomMnkGame::randomiseInto overwrites the target", "[PhantomMnkGame]")
+{
+    MockPhantomGame game;
+    std::vector<int> const sequence {4,4,0,6,2};
+
+    for (auto move : sequence)
+        game.doMove(move);
+    MockPhantomGame target;
+    REQUIRE(game.randomiseInto(target, 0));
+
+    CHECK(game.available(0) == target.available(0));
+    CHECK(game.available(1).size() == target.available(1).size());
+    CHECK(game.moves().size() == target.moves().size());
+    REQUIRE(target.board()[1][1] == 0);
+    REQUIRE(target.board()[2][0] == 0);
+}
+
+TEST_CASE("Game::randomiseInto is not supported by default", "[Game]")
+{
+    struct NoRandomiseInto : public MnkGame
+    {
+        bool randomiseInto(Game &target, Player observer) const override
+        {
+            return ISMCTS::Game<int>::randomiseInto(target, observer);
+        }
+    };
+    NoRandomiseInto game;
+    MnkGame target;
+    REQUIRE_FALSE(game.randomiseInto(target, 0));
+}
+
+TEST_CASE("Game::randomiseInto rejects targets of another class", "[MnkGame]")
+{
+    // Adds state without overriding randomiseInto
+    struct DerivedGame : public MnkGame
+    {
+        int extra {0};
+    };
+    MnkGame game;
+    DerivedGame target;
+    target.extra = 1;
+    REQUIRE_FALSE(game.randomiseInto(target, 0));
+    REQUIRE_FALSE(target.randomiseInto(game, 0));
+
+    MnkGame other;
+    game.doMove(4);
+    REQUIRE(game.randomiseInto(other, 0));
+    REQUIRE(other.validMoves() == game.validMoves());
+}
+
+namespace
+{
+
+// Play a random game, checking both ways of obtaining the valid moves
+template<class Game>
+bool fillValidMovesMatches(Game game)
+{
+    std::vector<typename Game::MoveType> moves {typename Game::MoveType{}};
+    while (true) {
+        game.fillValidMoves(moves);
+        if (moves != game.validMoves())
+            return false;
+        if (moves.empty())
+            return true;
+        doValidMove(game);
+    }
+}
+
+}
+
+TEST_CASE("Game::fillValidMoves agrees with validMoves", "[MnkGame][PhantomMnkGame][KnockoutWhist][Goofspiel]")
+{
+    CHECK(fillValidMovesMatches(MnkGame{}));
+    CHECK(fillValidMovesMatches(PhantomMnkGame{}));
+    CHECK(fillValidMovesMatches(KnockoutWhist{numPlayers}));
+    REQUIRE(fillValidMovesMatches(Goofspiel{}));
+}
@@ -9,6 +9,9 @@
 #include "common/knockoutwhist.h"
 #include "common/card.h"
 
+#include <algorithm>
+#include <future>
+#include <ostream>
 #include <vector>
 #include <numeric>
 
@@ -17,6 +20,31 @@ namespace
 using namespace ISMCTS;
 Card constexpr testMove {Card::Ace, Card::Spades};
 unsigned int constexpr testPlayer {1};
+
+// Move type without an ordering
+struct UnorderedMove
+{
+    int value;
+
+    UnorderedMove(int v = 0) : value{v} {}
+    bool operator==(UnorderedMove const &other) const { return value == other.value; }
+    friend std::ostream &operator<<(std::ostream &out, UnorderedMove const &m) { return out << m.value; }
+};
+
+// Policy that records the number of nodes it selects from
+template<class Move>
+struct CountingPolicy
+{
+    using Node = UCBNode<Move>;
+
+    std::size_t count {0};
+
+    Node *operator()(std::vector<Node*> const &nodes)
+    {
+        count = nodes.size();
+        return nodes.front();
+    }
+};
 }
 
 TEMPLATE_TEST_CASE("Nodes are constructed properly", "[node]", UCBNode<Card>, EXPNode<Card>)
@@ -48,6 +76,115 @@ TEMPLATE_TEST_CASE("Node::addChild works", "[node]", UCBNode<Card>, EXPNode<Card
     REQUIRE(child == root.children().front().get());
 }
 
+TEMPLATE_TEST_CASE("Iterators obtained before the first child was added reach it", "[node]", UCBNode<Card>, EXPNode<Card>)
+{
+    TestType root;
+    auto const first = root.children().begin();
+    auto const child = root.addChild(std::make_unique<TestType>(testMove, testPlayer));
+    auto const last = root.children().end();
+
+    REQUIRE(last - first == 1);
+    REQUIRE(first->get() == child);
+}
+
+TEMPLATE_TEST_CASE("Nodes can be allocated in an arena", "[node]", UCBNode<Card>, EXPNode<Card>)
+{
+    NodeArena arena {256};
+    auto root = Node<Card>::create<TestType>(arena);
+    Node<Card>* child {nullptr};
+
+    for (int i = 0; i < 20; ++i)
+        CHECK_NOTHROW([&]{ child = root->addChild(Node<Card>::create<TestType>(arena, testMove, testPlayer)); }());
+    CHECK(child->parent() == root.get());
+    CHECK(child->move() == testMove);
+    CHECK(root->children().size() == 20);
+    REQUIRE(arena.capacity() >= 21 * sizeof(TestType));
+}
+
+TEST_CASE("Child lists can be allocated in an arena", "[node]")
+{
+    NodeArena arena {256};
+    std::vector<int> items(100);
+    std::iota(items.begin(), items.end(), 0);
+    {
+        ChildList<std::unique_ptr<int>> list;
+        for (auto i : items)
+            list.push_back(std::make_unique<int>(i), &arena);
+        CHECK(arena.capacity() >= list.memoryUsage());
+
+        std::vector<int> values;
+        for (auto &item : list)
+            values.emplace_back(*item);
+        REQUIRE(values == items);
+    }
+    // The list's elements were destroyed, but the arena keeps its memory
+    REQUIRE(arena.capacity() > 0);
+}
+
+TEMPLATE_TEST_CASE("Node::findOrAddChild adds each move once when used concurrently", "[node]", UCBNode<int>, EXPNode<int>)
+{
+    TestType root;
+    std::vector<int> moves(100);
+    std::iota(moves.begin(), moves.end(), 0);
+
+    // Catch assertions are not thread-safe, so each thread reports success
+    std::vector<std::future<bool>> futures(4);
+    for (auto &f : futures) {
+        f = std::async(std::launch::async, [&]{
+            return std::all_of(moves.begin(), moves.end(), [&](int move){
+                auto const child = root.findOrAddChild(move, [&]{ return std::make_unique<TestType>(move, testPlayer); });
+                return child->move() == move;
+            });
+        });
+    }
+    for (auto &f : futures)
+        CHECK(f.get());
+
+    std::vector<int> childMoves;
+    for (auto &c : root.children())
+        childMoves.emplace_back(c->move());
+    std::sort(childMoves.begin(), childMoves.end());
+    REQUIRE(childMoves == moves);
+}
+
+TEMPLATE_TEST_CASE("Node::removeChild detaches a child", "[node]", UCBNode<int>, EXPNode<int>)
+{
+    TestType root;
+    std::vector<int> moves(20);
+    std::iota(moves.begin(), moves.end(), 0);
+    for (auto move : moves)
+        root.addChild(std::make_unique<TestType>(move, testPlayer));
+
+    auto const child = root.removeChild(8);
+    REQUIRE(child);
+    CHECK(child->move() == 8);
+    CHECK(child->parent() == nullptr);
+    CHECK_FALSE(root.removeChild(8));
+    moves.erase(moves.begin() + 8);
+
+    // Children can be added again after removal
+    for (int move = 20; move < 40; ++move) {
+        root.addChild(std::make_unique<TestType>(move, testPlayer));
+        moves.emplace_back(move);
+    }
+    std::vector<int> childMoves;
+    for (auto &c : root.children())
+        childMoves.emplace_back(c->move());
+    REQUIRE(childMoves == moves);
+}
+
+TEMPLATE_TEST_CASE("Nodes report their memory usage", "[node]", UCBNode<int>, EXPNode<int>, D_UCBNode<int>, SW_UCBNode<int>)
+{
+    TestType root;
+    auto const emptySize = root.memoryUsage();
+    CHECK(emptySize >= sizeof(TestType));
+    CHECK(root.treeMemoryUsage() == emptySize);
+
+    auto child = root.addChild(std::make_unique<TestType>(1));
+    CHECK(root.memoryUsage() > emptySize);
+    REQUIRE(root.treeMemoryUsage() == root.memoryUsage() + child->memoryUsage());
+}
+
 TEMPLATE_TEST_CASE("Node::update works", "[node]", UCBNode<Card>, EXPNode<Card>)
 {
     TestType root;
@@ -59,6 +196,24 @@ TEMPLATE_TEST_CASE("Node::update works", "[node]", UCBNode<Card>, EXPNode<Card>)
     REQUIRE(node->visits() == 1);
 }
 
+TEMPLATE_TEST_CASE("Nodes weighting each result are not updated in batches", "[node]", EXPNode<int>, D_UCBNode<int>, SW_UCBNode<int>)
+{
+    TestType root;
+    auto const node = root.addChild(std::make_unique<TestType>(1));
+    REQUIRE_FALSE(node->canBatchUpdates());
+}
+
+TEMPLATE_TEST_CASE("Node::update adds batches of results", "[node]", UCBNode<int>)
+{
+    TestType root;
+    auto const node = root.addChild(std::make_unique<TestType>(1));
+    REQUIRE(node->canBatchUpdates());
+    node->addVirtualLoss(3);
+    node->update(3, 1.5, 3);
+    CHECK(node->visits() == 3);
+    REQUIRE(node->virtualLoss() == 0);
+}
+
 TEMPLATE_TEST_CASE("Node::untriedMoves returns expected values", "[node]", UCBNode<int>, EXPNode<int>)
 {
     TestType root;
@@ -78,3 +233,50 @@ TEMPLATE_TEST_CASE("Node::untriedMoves returns expected values", "[node]", UCBNo
     }
 
 }
+
+// Ordered moves are matched through a sorted index once there are enough of
+// them, others always by linear search
+TEMPLATE_TEST_CASE("Nodes match many legal moves to their children", "[node]", int, UnorderedMove)
+{
+    auto const numMoves = GENERATE(64, 1000);
+    auto const childStep = GENERATE(2, 50);
+    UCBNode<TestType> root;
+    std::vector<TestType> legalMoves, untried;
+    for (int i = numMoves - 1; i >= 0; --i)
+        legalMoves.emplace_back(i);
+    for (int i = 0; i < numMoves + 40; i += childStep)
+        root.addChild(std::make_unique<UCBNode<TestType>>(i));
+
+    // Children past the last legal move are illegal
+    std::size_t legalChildren {0};
+    for (auto &m : legalMoves) {
+        if (std::none_of(root.children().begin(), root.children().end(), [&](auto const &c){ return c->move() == m; }))
+            untried.emplace_back(m);
+        else
+            ++legalChildren;
+    }
+    CHECK(root.untriedMoves(legalMoves) == untried);
+    CHECK(root.hasUntriedMoves(legalMoves));
+
+    CountingPolicy<TestType> policy;
+    root.selectChild(legalMoves, policy);
+    REQUIRE(policy.count == legalChildren);
+}
+
+TEST_CASE("AtomicFixedPoint sums concurrent additions exactly", "[node]")
+{
+    AtomicFixedPoint<> sum {0.5};
+    std::vector<std::future<void>> futures(4);
+    for (auto &f : futures) {
+        f = std::async(std::launch::async, [&]{
+            for (int i = 0; i < 1000; ++i)
+                sum += 0.25;
+        });
+    }
+    for (auto &f : futures)
+        f.get();
+    CHECK(double(sum) == 1000.5);
+
+    sum += -1000;
+    REQUIRE(double(sum) == 0.5);
+}
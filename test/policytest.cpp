@@ -10,7 +10,13 @@
 #include <ismcts/utility.h>
 
 #include <algorithm>
+#include <cmath>
+#include <functional>
 #include <memory>
+#include <numeric>
+#include <random>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 namespace
@@ -88,3 +94,224 @@ TEMPLATE_PRODUCT_TEST_CASE("Common tree policy tests", "[UCB1][EXP3][D_UCB][SW_U
         REQUIRE(selection == firstNode);
     }
 }
+
+TEMPLATE_PRODUCT_TEST_CASE("Virtual loss steers UCB policies away from a node", "[UCB1][D_UCB][SW_UCB]", (UCB1, D_UCB, SW_UCB), int)
+{
+    using Node = typename TestType::Node;
+
+    Node root;
+    for (int i = 0; i < 2; ++i) {
+        auto const child = root.addChild(std::make_unique<Node>(i));
+        child->update(win);
+    }
+
+    auto const &nodes = root.children();
+    auto const firstNode = nodes.front().get();
+    firstNode->addVirtualLoss(1);
+
+    TestType policy;
+    REQUIRE(root.selectChild({0, 1}, policy) != firstNode);
+
+    // Removing the virtual loss upon backpropagation restores the node
+    firstNode->update(win, 1);
+    CHECK(firstNode->virtualLoss() == 0);
+    REQUIRE(firstNode->visits() == 2);
+}
+
+TEST_CASE("D_UCB nodes discount their results incrementally", "[D_UCB]")
+{
+    double constexpr gamma {0.9};
+    auto const powers = std::make_shared<PositiveIntegerPowers<double> const>(gamma);
+    std::vector<std::pair<unsigned, double>> history;
+    D_UCBNode<int> root;
+    auto const a = static_cast<D_UCBNode<int>*>(root.addChild(std::make_unique<D_UCBNode<int>>()));
+    auto const b = static_cast<D_UCBNode<int>*>(root.addChild(std::make_unique<D_UCBNode<int>>()));
+    b->setDiscount(powers);
+
+    for (int i = 0; i < 50; ++i) {
+        a->markAvailable();
+        b->markAvailable();
+        if (i % 3 == 0)
+            continue;
+        auto const &result = i % 2 ? win : loss;
+        a->update(result);
+        b->update(result);
+        history.emplace_back(a->available(), result.getResult(0));
+    }
+
+    double N {0}, X {0};
+    for (auto const &h : history) {
+        N += std::pow(gamma, a->available() - h.first);
+        X += std::pow(gamma, a->available() - h.first) * h.second;
+    }
+    for (auto node : {a, b}) {
+        auto const sums = node->discountSums(powers);
+        CHECK(std::get<0>(sums) == Approx(N));
+        CHECK(std::get<1>(sums) == Approx(X));
+    }
+    REQUIRE(a->memoryUsage() == b->memoryUsage());
+}
+
+TEST_CASE("SW_UCB nodes only count results within the window", "[SW_UCB]")
+{
+    unsigned constexpr window {10};
+    std::vector<std::pair<unsigned, double>> history;
+    SW_UCBNode<int> root;
+    auto const a = static_cast<SW_UCBNode<int>*>(root.addChild(std::make_unique<SW_UCBNode<int>>()));
+    auto const b = static_cast<SW_UCBNode<int>*>(root.addChild(std::make_unique<SW_UCBNode<int>>()));
+    b->setWindow(window);
+
+    for (int i = 0; i < 50; ++i) {
+        a->markAvailable();
+        b->markAvailable();
+        if (i % 3 == 0)
+            continue;
+        auto const &result = i % 2 ? win : loss;
+        a->update(result);
+        b->update(result);
+        history.emplace_back(a->available(), result.getResult(0));
+    }
+
+    unsigned N {0};
+    double X {0};
+    for (auto const &h : history) {
+        if (h.first > a->available() - window) {
+            ++N;
+            X += h.second;
+        }
+    }
+    for (auto node : {a, b}) {
+        auto const sums = node->rewardSums(window);
+        CHECK(std::get<0>(sums) == N);
+        CHECK(std::get<1>(sums) == Approx(X));
+    }
+    // Each stored result holds a double and an unsigned
+    REQUIRE(b->memoryUsage() <= sizeof(SW_UCBNode<int>) + window * 2 * sizeof(double));
+}
+
+TEST_CASE("SW_UCB nodes keep their results when the window changes", "[SW_UCB]")
+{
+    SW_UCBNode<int> root;
+    auto const node = static_cast<SW_UCBNode<int>*>(root.addChild(std::make_unique<SW_UCBNode<int>>()));
+    auto const update = [&](double result){
+        node->markAvailable();
+        node->update(TestGame{result});
+    };
+
+    // Six results in a window of four wrap around the end of the buffer
+    node->setWindow(4);
+    for (int i = 0; i < 6; ++i)
+        update(i);
+
+    SECTION("Growing the window") {
+        node->setWindow(6);
+        CHECK(node->rewardSums(6) == std::make_tuple(4u, 14.));
+        update(6);
+        REQUIRE(node->rewardSums(6) == std::make_tuple(5u, 20.));
+    }
+
+    SECTION("Shrinking the window") {
+        node->setWindow(2);
+        CHECK(node->rewardSums(2) == std::make_tuple(2u, 9.));
+        update(6);
+        REQUIRE(node->rewardSums(2) == std::make_tuple(2u, 11.));
+    }
+}
+
+TEST_CASE("SW_UCB nodes only allocate memory for the results they hold", "[SW_UCB]")
+{
+    // Each stored result holds a double and an unsigned
+    using Result = std::pair<double, unsigned>;
+    SW_UCB<int> const policy;
+    SW_UCBNode<int> root;
+    auto const node = static_cast<SW_UCBNode<int>*>(root.addChild(std::make_unique<SW_UCBNode<int>>()));
+    policy.initialise(*node);
+    auto const emptySize = node->memoryUsage();
+    CHECK(emptySize < sizeof(SW_UCBNode<int>) + 100);
+
+    auto const update = [&](unsigned count){
+        for (unsigned i = 0; i < count; ++i) {
+            node->markAvailable();
+            node->update(win);
+        }
+    };
+
+    // A few results take little space, and a full default window of 500 is
+    // kept without allocating more than it needs
+    update(10);
+    CHECK(node->memoryUsage() <= emptySize + 20 * sizeof(Result));
+    update(2000);
+    CHECK(node->memoryUsage() <= emptySize + 500 * sizeof(Result));
+    REQUIRE(std::get<0>(node->rewardSums(0)) == 500);
+}
+
+TEST_CASE("PositiveIntegerPowers computes powers beyond its table", "[D_UCB]")
+{
+    PositiveIntegerPowers<double> const powers {0.5, 4};
+    CHECK(powers.base() == 0.5);
+    CHECK(powers(0) == 1);
+    CHECK(powers(3) == 0.125);
+    REQUIRE(powers(6) == Approx(std::pow(0.5, 6)));
+}
+
+TEST_CASE("EXP3 handles large scores", "[EXP3]")
+{
+    using Node = EXP3<int>::Node;
+
+    Node root;
+    for (int i = 0; i < 3; ++i)
+        root.addChild(std::make_unique<Node>(i));
+    auto const &nodes = root.children();
+    auto const best = static_cast<Node*>(nodes.front().get());
+    best->setProbability(1e-6);
+    best->update(win);
+    std::for_each(nodes.begin() + 1, nodes.end(), [](auto &n){ n->update(loss); });
+
+    EXP3<int> policy;
+    for (int i = 0; i < 10; ++i) {
+        auto const selection = root.selectChild({0, 1, 2}, policy);
+        REQUIRE(selection != nullptr);
+        // Selection updated the probabilities, which must remain positive
+        auto const score = best->score();
+        best->update(win);
+        REQUIRE(std::isfinite(best->score()));
+        REQUIRE(best->score() > score);
+    }
+}
+
+TEST_CASE("UCB scores use tabulated logarithms", "[UCB1]")
+{
+    for (unsigned int n : {1u, 2u, 100u, 4095u, 4096u, 100000u})
+        CHECK(logarithm(n) == Approx(std::log(n)));
+    REQUIRE(ucbFromTable(0.5, 0.7, 100u, 10.) == Approx(ucb(0.5, 0.7, 100., 10.)));
+
+    // Integer counts still select the original overload
+    REQUIRE(ucb(0.5, 0.7, 3, 10.) == Approx(0.5 + 0.7 * std::sqrt(std::log(3) / 10.)));
+}
+
+TEMPLATE_TEST_CASE("randomIndex draws uniformly distributed indices", "[RandomElement]", Xoshiro256, std::mt19937)
+{
+    TestType rng {42};
+    std::size_t constexpr n {5};
+    std::vector<unsigned int> counts(n);
+    for (int i = 0; i < 50000; ++i) {
+        auto const index = randomIndex(n, rng);
+        if (index < n)
+            ++counts[index];
+    }
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0u) == 50000);
+    for (auto count : counts)
+        CHECK(count == Approx(10000).epsilon(0.05));
+    REQUIRE(randomIndex(1, rng) == 0);
+}
+
+TEST_CASE("Xoshiro256 is determined by its seed", "[RandomElement]")
+{
+    Xoshiro256 a {1}, b {1}, c {2};
+    std::vector<Xoshiro256::result_type> x(8), y(8), z(8);
+    std::generate(x.begin(), x.end(), std::ref(a));
+    std::generate(y.begin(), y.end(), std::ref(b));
+    std::generate(z.begin(), z.end(), std::ref(c));
+    CHECK(x == y);
+    REQUIRE(x != z);
+}
@@ -12,8 +12,13 @@
 #include "common/goofspiel.h"
 #include "common/utility.h"
 
+#include <future>
+#include <thread>
+#include <map>
 #include <vector>
 #include <memory>
+#include <stdexcept>
+#include <type_traits>
 
 namespace
 {
@@ -42,6 +47,60 @@ using SODefault = Default<SOSolver>::Type<Ts...>;
 template<class... Ts>
 using MODefault = Default<MOSolver>::Type<Ts...>;
 
+template<class Move>
+unsigned int totalVirtualLoss(Node<Move> const &node)
+{
+    auto total = node.virtualLoss();
+    for (auto &c : node.children())
+        total += totalVirtualLoss(*c);
+    return total;
+}
+
+template<class Node>
+unsigned int totalVirtualLoss(std::shared_ptr<Node> const &root)
+{
+    return totalVirtualLoss(*root);
+}
+
+template<class Tree>
+unsigned int totalVirtualLoss(std::map<unsigned int, Tree> const &trees)
+{
+    unsigned int total {0};
+    for (auto &pair : trees)
+        total += totalVirtualLoss(pair.second);
+    return total;
+}
+
+template<class Node>
+std::shared_ptr<Node> playerTree(std::shared_ptr<Node> const &tree, unsigned int)
+{
+    return tree;
+}
+
+template<class Tree>
+Tree playerTree(std::map<unsigned int, Tree> const &trees, unsigned int player)
+{
+    return trees.at(player);
+}
+
+template<class Node>
+unsigned int childVisits(Node const &root)
+{
+    unsigned int visits {0};
+    for (auto &c : root->children())
+        visits += c->visits();
+    return visits;
+}
+
+template<class Node>
+std::vector<unsigned int> childVisitCounts(Node const &root)
+{
+    std::vector<unsigned int> visits;
+    for (auto &c : root->children())
+        visits.push_back(c->visits());
+    return visits;
+}
+
 // In this state, player 1 has to choose between move 2, ending in a draw, and
 // move 0, ending in a loss
 struct P1DrawOrLose : public MnkGame
@@ -59,10 +118,58 @@ struct P1DrawOrLose : public MnkGame
     }
 };
 
+// A game that fails whenever it is determinised
+struct FailingGame : public P1DrawOrLose
+{
+    Clone cloneAndRandomise(Player) const override
+    {
+        throw std::runtime_error{"Failed to determinise"};
+    }
+};
+
+
+// A final game whose playouts fail on the tree thread of a leaf parallel
+// search, while the additional playouts, made from the leaf states, are slowed
+// down so that they are still running
+struct FailingPlayoutGame final : public MnkGame
+{
+    bool failsPlayout {false};
+
+    Clone cloneAndRandomise(Player) const override
+    {
+        auto clone = std::make_unique<FailingPlayoutGame>(*this);
+        clone->failsPlayout = m_moves.size() == 9;
+        return clone;
+    }
+
+    void doMove(int const move) override
+    {
+        if (m_moves.size() < 8) {
+            if (failsPlayout)
+                throw std::runtime_error{"Failed to play out"};
+            std::this_thread::sleep_for(1ms);
+        }
+        MnkGame::doMove(move);
+    }
+};
+
+// UCB1 policy summing the virtual losses of the nodes it selects from
+template<class Move>
+struct VirtualLossCounter : public UCB1<Move>
+{
+    std::shared_ptr<std::atomic_uint> total {std::make_shared<std::atomic_uint>(0)};
+
+    typename UCB1<Move>::Node *operator()(std::vector<typename UCB1<Move>::Node*> const &nodes) const
+    {
+        for (auto node : nodes)
+            *total += node->virtualLoss();
+        return UCB1<Move>::operator()(nodes);
+    }
+};
 }
 
 TEMPLATE_PRODUCT_TEST_CASE("Solvers construct properly", "[SOSolver][MOSolver]",
-    (SODefault, MODefault), (Card, (Card, RootParallel), (Card, TreeParallel)))
+    (SODefault, MODefault), (Card, (Card, RootParallel), (Card, TreeParallel), (Card, LeafParallel), (Card, HybridParallel)))
 {
     SECTION("By iteration count") {
         TestType solver {iterationCount};
@@ -78,7 +185,7 @@ TEMPLATE_PRODUCT_TEST_CASE("Solvers construct properly", "[SOSolver][MOSolver]",
 }
 
 TEMPLATE_PRODUCT_TEST_CASE("Solver settings can be modified", "[SOSolver][MOSolver]",
-    (SODefault, MODefault), (Card, (Card, RootParallel), (Card, TreeParallel)))
+    (SODefault, MODefault), (Card, (Card, RootParallel), (Card, TreeParallel), (Card, LeafParallel), (Card, HybridParallel)))
 {
     TestType solver {iterationCount};
 
@@ -99,7 +206,7 @@ TEMPLATE_PRODUCT_TEST_CASE("Solver settings can be modified", "[SOSolver][MOSolv
 }
 
 TEMPLATE_PRODUCT_TEST_CASE("Solvers' operator() returns a valid move", "[SOSolver][MOSolver]",
-    (SODefault, MODefault), (Card, (Card, RootParallel), (Card, TreeParallel)))
+    (SODefault, MODefault), (Card, (Card, RootParallel), (Card, TreeParallel), (Card, LeafParallel), (Card, HybridParallel)))
 {
     auto solver = GENERATE(std::make_shared<TestType>(iterationCount), std::make_shared<TestType>(iterationTime));
     Card move;
@@ -129,10 +236,376 @@ TEMPLATE_PRODUCT_TEST_CASE("Solvers' operator() returns a valid move", "[SOSolve
 }
 
 TEMPLATE_PRODUCT_TEST_CASE("Solvers select the most rewarding final move", "[SOSolver][MOSolver]",
-    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel)))
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, LeafParallel), (int, HybridParallel)))
 {
     P1DrawOrLose game;
     TestType solver {16};
     auto const move = solver(game);
     REQUIRE(move == 2);
 }
+
+TEMPLATE_PRODUCT_TEST_CASE("Virtual losses are removed after searching", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, LeafParallel), (int, HybridParallel)))
+{
+    P1DrawOrLose game;
+    TestType solver {16};
+    solver.setVirtualLoss(3);
+    CHECK(solver.virtualLoss() == 3);
+    REQUIRE(solver(game) == 2);
+    for (auto &tree : solver.currentTrees())
+        REQUIRE(totalVirtualLoss(tree) == 0);
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Solvers can reuse trees for the next move", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, LeafParallel), (int, HybridParallel)))
+{
+    MnkGame game;
+    TestType solver {100};
+    std::vector<int> moves {solver(game)};
+    game.doMove(moves.back());
+    moves.emplace_back(randomMove(game));
+    game.doMove(moves.back());
+    auto const validMoves = game.validMoves();
+
+    SECTION("Advancing by played moves keeps the subtree") {
+        REQUIRE(solver.advanceTrees(moves));
+        auto const trees = solver.currentTrees();
+        auto const &root = playerTree(trees.front(), game.currentPlayer());
+        CHECK(root->parent() == nullptr);
+        auto const retainedVisits = childVisits(root);
+
+        auto const move = solver(game);
+        CHECK(std::find(validMoves.begin(), validMoves.end(), move) != validMoves.end());
+        REQUIRE(childVisits(playerTree(solver.currentTrees().front(), game.currentPlayer())) > retainedVisits);
+    }
+
+    SECTION("Advancing before any search keeps nothing") {
+        TestType other {100};
+        REQUIRE_FALSE(other.advanceTrees(moves));
+        auto const move = other(game);
+        REQUIRE(std::find(validMoves.begin(), validMoves.end(), move) != validMoves.end());
+    }
+
+    SECTION("Advancing by an unknown move discards the trees") {
+        REQUIRE_FALSE(solver.advanceTrees({-1}));
+        auto const move = solver(game);
+        REQUIRE(std::find(validMoves.begin(), validMoves.end(), move) != validMoves.end());
+    }
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Root parallel solvers ignore discarded trees when asked for a move", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), ((int, RootParallel)))
+{
+    MnkGame game;
+    TestType solver {400, 8};
+    solver(game);
+    auto const player = game.currentPlayer();
+    auto const trees = solver.currentTrees();
+
+    // Find two moves leading to a node with children in one tree, which some
+    // other tree lacks; threads may steal iterations, so trees differ in size
+    auto const contains = [&](std::size_t tree, int first, int second){
+        for (auto &c : playerTree(trees[tree], player)->children()) {
+            if (c->move() != first)
+                continue;
+            for (auto &g : c->children()) {
+                if (g->move() == second)
+                    return true;
+            }
+        }
+        return false;
+    };
+    std::vector<int> moves;
+    for (std::size_t kept = 0; kept < trees.size() && moves.empty(); ++kept) {
+        for (auto &c : playerTree(trees[kept], player)->children()) {
+            for (auto &g : c->children()) {
+                bool missing {false};
+                for (std::size_t t = 0; t < trees.size(); ++t)
+                    missing = missing || !contains(t, c->move(), g->move());
+                if (missing && !g->children().empty() && moves.empty())
+                    moves = {c->move(), g->move()};
+            }
+        }
+    }
+    REQUIRE(moves.size() == 2);
+
+    CHECK_FALSE(solver.advanceTrees(moves));
+    REQUIRE(solver.hasBestMove());
+    for (auto move : moves)
+        game.doMove(move);
+    auto const validMoves = game.validMoves();
+    auto const move = solver.currentBestMove();
+    REQUIRE(std::find(validMoves.begin(), validMoves.end(), move) != validMoves.end());
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Solvers can share a thread pool", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, LeafParallel), (int, HybridParallel)))
+{
+    auto const pool = std::make_shared<ThreadPool>(2);
+    TestType solver1 {16}, solver2 {16};
+    solver1.setThreadPool(pool);
+    solver2.setThreadPool(pool);
+    REQUIRE(solver1.threadPool() == solver2.threadPool());
+
+    // Repeated searches reuse the same workers
+    P1DrawOrLose game;
+    for (int i = 0; i < 3; ++i) {
+        CHECK(solver1(game) == 2);
+        CHECK(solver2(game) == 2);
+    }
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Seeded sequential searches are reproducible", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (Card))
+{
+    KnockoutWhist const game {numPlayers};
+    auto search = [&](std::uint64_t seed){
+        TestType solver {200};
+        solver.setSeed(seed);
+        REQUIRE(solver.isSeeded());
+        solver(game);
+        solver(game);
+        return childVisitCounts(playerTree(solver.currentTrees().front(), game.currentPlayer()));
+    };
+    auto const visits = search(42);
+    REQUIRE(search(42) == visits);
+    REQUIRE(search(43) != visits);
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Seeded tree and leaf parallel searches are reproducible", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), ((Card, TreeParallel), (Card, LeafParallel)))
+{
+    // Tree parallel searches are only reproducible with a single thread, leaf
+    // parallel ones with any number of playout threads
+    auto const numThreads = std::is_base_of<LeafParallel, TestType>::value ? 4u : 1u;
+    KnockoutWhist const game {numPlayers};
+    auto search = [&](std::uint64_t seed){
+        TestType solver {std::size_t(200), numThreads};
+        solver.setSeed(seed);
+        solver(game);
+        solver(game);
+        return childVisitCounts(playerTree(solver.currentTrees().front(), game.currentPlayer()));
+    };
+    auto const visits = search(42);
+    REQUIRE(search(42) == visits);
+    REQUIRE(search(43) != visits);
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Searches are random again after clearing the seed", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), ((Card, TreeParallel), (Card, LeafParallel)))
+{
+    // The pool and leaf parallel playout threads keep the state of their last
+    // seeded search unless they are reseeded
+    auto const numThreads = std::is_base_of<LeafParallel, TestType>::value ? 4u : 1u;
+    KnockoutWhist const game {numPlayers};
+    auto search = [&]{
+        TestType solver {std::size_t(200), numThreads};
+        solver.setSeed(42);
+        solver(game);
+        solver.clearSeed();
+        CHECK_FALSE(solver.isSeeded());
+        solver(game);
+        return childVisitCounts(playerTree(solver.currentTrees().front(), game.currentPlayer()));
+    };
+    REQUIRE(search() != search());
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Batched updates are complete after searching", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, HybridParallel)))
+{
+    P1DrawOrLose game;
+    TestType solver {100};
+    solver.setVirtualLoss(1);
+    solver.setBatchedUpdates(2, 7);
+    CHECK(solver.batchDepth() == 2);
+    CHECK(solver.batchSize() == 7);
+    REQUIRE(solver(game) == 2);
+
+    unsigned int visits {0};
+    for (auto &tree : solver.currentTrees()) {
+        REQUIRE(totalVirtualLoss(tree) == 0);
+        visits += childVisits(playerTree(tree, game.currentPlayer()));
+    }
+    REQUIRE(visits == solver.iterationCount());
+}
+
+TEMPLATE_TEST_CASE("Batched updates do not keep the virtual losses of finished iterations", "[SOSolver][MOSolver]",
+    (SOSolver<int, Sequential, VirtualLossCounter>), (MOSolver<int, Sequential, VirtualLossCounter>))
+{
+    // In a sequential search, the nodes selected from are never on the path of
+    // the current iteration, so they have no virtual loss
+    MnkGame game;
+    VirtualLossCounter<int> policy;
+    TestType solver {200};
+    solver.setConfig(policy);
+    solver.setVirtualLoss(1);
+    solver.setBatchedUpdates(3, 50);
+    solver(game);
+    REQUIRE(*policy.total == 0);
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Leaf parallel iterations add one result per thread", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), ((int, LeafParallel)))
+{
+    P1DrawOrLose game;
+    TestType solver {50, 3};
+    REQUIRE(solver(game) == 2);
+    auto const &root = playerTree(solver.currentTrees().front(), game.currentPlayer());
+    CHECK(childVisits(root) == 50 * solver.numThreads());
+
+    // The tree thread runs one of the playouts itself
+    REQUIRE(solver.threadPool()->size() == solver.numThreads() - 1);
+
+    // A single thread searches on the pool, like a sequential solver
+    TestType single {50, 1};
+    REQUIRE(single(game) == 2);
+    CHECK(childVisits(playerTree(single.currentTrees().front(), game.currentPlayer())) == 50);
+    REQUIRE(single.threadPool()->size() == 1);
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Leaf parallel playouts determinise for the player to move", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), ((Card, LeafParallel)))
+{
+    // Goofspiel only accepts determinisations for its current player, which
+    // differs from the root player at the leaves after the first move
+    Goofspiel game;
+    game.doMove(game.validMoves().front());
+    TestType solver {50, 4};
+    auto const move = solver(game);
+    auto const validMoves = game.validMoves();
+    REQUIRE(std::find(validMoves.begin(), validMoves.end(), move) != validMoves.end());
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Hybrid parallel solvers share each tree among several threads", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), ((int, HybridParallel)))
+{
+    P1DrawOrLose game;
+    TestType solver {100, 3, 2};
+    CHECK(solver.numTrees() == 3);
+    CHECK(solver.threadsPerTree() == 2);
+    REQUIRE(solver.numThreads() == 6);
+
+    REQUIRE(solver(game) == 2);
+    auto const trees = solver.currentTrees();
+    REQUIRE(trees.size() == 3);
+    unsigned int visits {0};
+    for (auto &tree : trees)
+        visits += childVisits(playerTree(tree, game.currentPlayer()));
+    REQUIRE(visits == 100);
+}
+
+TEST_CASE("IterationScheduler hands out each iteration once", "[IterationScheduler]")
+{
+    IterationScheduler scheduler;
+    unsigned int constexpr numWorkers {4};
+    scheduler.reset(1001, numWorkers);
+    REQUIRE(scheduler.remaining() == 1001);
+
+    SECTION("A single worker steals all iterations") {
+        std::size_t claimed {0};
+        while (scheduler.claim(0))
+            ++claimed;
+        CHECK(claimed == 1001);
+        REQUIRE(scheduler.remaining() == 0);
+    }
+
+    SECTION("Concurrent workers claim every iteration exactly once") {
+        std::vector<std::future<std::size_t>> futures(numWorkers);
+        for (unsigned int w = 0; w < numWorkers; ++w) {
+            futures[w] = std::async(std::launch::async, [&scheduler, w]{
+                std::size_t claimed {0};
+                while (scheduler.claim(w))
+                    ++claimed;
+                return claimed;
+            });
+        }
+        std::size_t total {0};
+        for (auto &f : futures)
+            total += f.get();
+        REQUIRE(total == 1001);
+    }
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Solvers search until the common deadline", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, HybridParallel)))
+{
+    using Clock = ExecutionPolicy::Clock;
+    MnkGame game;
+    TestType solver {Duration{20ms}};
+    auto const start = Clock::now();
+    solver(game);
+    auto const elapsed = Clock::now() - start;
+    CHECK(elapsed >= 20ms);
+    REQUIRE(elapsed < 500ms);
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Searches can run asynchronously and be stopped", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, LeafParallel), (int, HybridParallel)))
+{
+    using Clock = ExecutionPolicy::Clock;
+    P1DrawOrLose game;
+    auto solver = GENERATE(std::make_shared<TestType>(std::size_t(1) << 30), std::make_shared<TestType>(Duration{60s}));
+
+    auto const start = Clock::now();
+    solver->start(game);
+    CHECK(solver->isSearching());
+    while (!solver->hasBestMove())
+        std::this_thread::yield();
+    auto const move = solver->currentBestMove();
+    CHECK((move == 0 || move == 2));
+
+    std::this_thread::sleep_for(20ms);
+    solver->stop();
+    CHECK(solver->wait() == 2);
+    CHECK_FALSE(solver->isSearching());
+    REQUIRE(Clock::now() - start < 10s);
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Exceptions thrown by the game during a search reach the caller", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, LeafParallel), (int, HybridParallel)))
+{
+    FailingGame const failingGame;
+    P1DrawOrLose const game;
+    TestType solver {16};
+
+    SECTION("When waiting for the result") {
+        REQUIRE_THROWS_AS(solver(failingGame), std::runtime_error);
+        CHECK_FALSE(solver.isSearching());
+        REQUIRE(solver(game) == 2);
+    }
+
+    SECTION("Not at all if the solver is destroyed without waiting") {
+        auto other = std::make_unique<TestType>(16);
+        other->start(failingGame);
+        REQUIRE_NOTHROW(other.reset());
+    }
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Exceptions thrown during leaf parallel playouts reach the caller", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), ((int, LeafParallel)))
+{
+    FailingPlayoutGame const game;
+    TestType solver {16, 4};
+    REQUIRE_THROWS_AS(solver(game), std::runtime_error);
+    REQUIRE_FALSE(solver.isSearching());
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Asking for a move before one was found throws", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, LeafParallel)))
+{
+    TestType solver;
+    CHECK_FALSE(solver.hasBestMove());
+    REQUIRE_THROWS_AS(solver.currentBestMove(), std::runtime_error);
+}
+
+TEMPLATE_PRODUCT_TEST_CASE("Solvers find a move within a very short time", "[SOSolver][MOSolver]",
+    (SODefault, MODefault), (int, (int, RootParallel), (int, TreeParallel), (int, HybridParallel)))
+{
+    P1DrawOrLose game;
+    for (int i = 0; i < 20; ++i) {
+        // A new solver also has to start its threads within the time
+        TestType solver {Duration{50us}};
+        auto const move = solver(game);
+        REQUIRE((move == 0 || move == 2));
+    }
+}